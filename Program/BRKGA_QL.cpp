@@ -30,7 +30,10 @@ int main()
 		strcpy(instance,nameTable);
         
 		//read the informations of the instance
-		ReadData(nameTable, n, node, dist, vehicle, nbVehicles, nbUsers, periodLength, H, oDepotIDs, fDepotIDs, cStations, maxRideTimes, weights, elecPrices, cons);
+		ReadData(nameTable, n, problem);
+
+		// the decoding bounds of the pruning need the triangle inequality
+		if (prune) CheckTriangleInequality(problem);
 
 		double foBest = INFINITY,
 		       foAverage = 0;
@@ -61,7 +64,7 @@ int main()
 		for (int j=0; j<MAXRUNS; j++)
 		{
 		    // fixed seed
-		    srand(j+1); 
+		    SeedRandom(j+1); 
 		    //srand(time(NULL));
 
 		    printf("%d ", j+1);
@@ -98,13 +101,13 @@ int main()
             lss.push_back(bestSolution.flag);
 
             // Decoder usage of each solution found in the runs
-            decs.push_back(bestSolution.vec[n].rk);
+            decs.push_back(bestSolution.vec[n]);
 
             // Scheduling usage of each solution found in the runs
-            scheds.push_back(bestSolution.vec[n - 1].rk);
+            scheds.push_back(bestSolution.vec[n - 1]);
 
             // Charging priority usage of each solution found in the runs
-            cps.push_back(bestSolution.vec[n - 2].rk);
+            cps.push_back(bestSolution.vec[n - 2]);
 
 
 		    timeBest += (float)(CPUbest - CPUbegin)/CLOCKS_PER_SEC;
@@ -119,21 +122,21 @@ int main()
 		timeTotal = timeTotal / MAXRUNS;
 
         // Calculate TRT, ERT and CC seperately for best solution
-        splitF0(sBest, node,dist,nbVehicles,nbUsers, periodLength, maxRideTimes, weights, elecPrices);
+        splitF0(sBest, problem);
 
 		if (!debug)
 		{
-			WriteSolution(sBest, n, timeBest, timeTotal, instance);
+			WriteSolution(sBest, n, timeBest, timeTotal, instance, problem);
 			WriteResults(foBest, foAverage, fos, lss, decs, scheds, cps, timeBest, timeTotal, instance, ls, sBest.TRT, sBest.ERT, sBest.CC);
 		}
 		else
 		{
-		    WriteSolutionScreen(sBest, n, timeBest, timeTotal, instance, nbVehicles);
+		    WriteSolutionScreen(sBest, n, timeBest, timeTotal, instance, problem);
 		}
 
 		// free memory of problem variables
 		FreeMemory();
-		FreeMemoryProblem(node, dist, vehicle, oDepotIDs, fDepotIDs,cStations, maxRideTimes, elecPrices, cons);
+		FreeMemoryProblem(problem);
 		//FreeMemoryProblem();
 	}
 
@@ -155,36 +158,51 @@ void BRKGA()
     Pop.clear();
     PopInter.clear();
 
+    // one best solution slot per thread
+    bestFo = bestSolution.fo;
+    threadBest.assign(MAX_THREADS, TSol());
+    for (unsigned t = 0; t < MAX_THREADS; t++) threadBest[t].fo = INFINITY;
+    threadBestTime.assign(MAX_THREADS, CPUbest);
+
+#ifdef FITNESS_CACHE
+    // decoded solutions are only valid for this instance (and the cache counts hits per run)
+    fitnessCache.Reset(4096);
+#endif
+
     // population size
     p = sizeP[sizeof(sizeP)/sizeof(sizeP[0]) - 1]; //higher population size
 
-    Pop.resize(p);
-    PopInter.resize(p);
+    Pop.resize(p, n+1);
+    PopInter.resize(p, n+1);
 
     // Create the initial chromossoms with random keys
     #pragma omp parallel for num_threads(MAX_THREADS)
     for (int i=0; i<p; i++)
     {
-        TSol ind = CreateInitialSolutions(); 
-        ind = Decoder(ind, n, node, dist, vehicle, nbVehicles, nbUsers, periodLength, H, oDepotIDs, fDepotIDs, cStations, maxRideTimes, weights, elecPrices, cons);
-        Pop[i] = PopInter[i] = ind;
+        TSol& ind = decodeSol;
+        CreateInitialSolutions(ind);
+        DecodeIndividual(ind, false, INFINITY, nullptr, &Pop.trace[i]);
+        Pop.store(i, ind);
 
         // save the best solution found in this run
-        updateBestSolution(Pop[i]);
+        updateBestSolution(ind);
     }
     
-    // sort population in increase order of fitness
-    sort(Pop.begin(), Pop.end(), sortByFitness);
+    // rank population in increase order of fitness
+    rankOrder.resize(p);
+    iota(rankOrder.begin(), rankOrder.end(), 0);
+    RankPopulation((int)(p*pe));
 
     
     int numGenerations = 0;             // number of generations
     int bestGeneration = 0;             // generation in which found the best solution
-    double bestFitness = Pop[0].fo;     // best fitness found in past generations
+    double bestFitness = Pop.fo[rankOrder[0]]; // best fitness found in past generations
     double averageOffspring = 0;        // average fitness of offsprings
     double lastAvgOffspring = 0;        // last average fitness of offsprings
     double bestOffspring = 0;           // best offspring of each generation
     float currentTime = 0;              // computational time of the search process
     int numLS = 0;                      // number of local search applied in a generation
+    long long numPruned = 0;            // number of offspring whose decoding was stopped by the bound
 
     // run the evolutionary process until stop criterion
     while(1)
@@ -196,55 +214,99 @@ void BRKGA()
         ChooseAction(numGenerations);
 
         // define population size
-        if (Pop.size() > p)
+        if ((int)rankOrder.size() > p)
         {
-            Pop.resize(p);
-            PopInter.resize(p);
+            // keep the p best chromosomes
+            nth_element(rankOrder.begin(), rankOrder.begin() + p, rankOrder.end(), sortByFitness);
+            rankOrder.resize(p);
         }
-        else if (Pop.size() < p)
+        else if ((int)rankOrder.size() < p)
         {
-            int currentP = Pop.size();
+            int currentP = rankOrder.size();
 
-            Pop.resize(p);
-            PopInter.resize(p);
+            Pop.resize(p, n+1);
             
             for (int k = currentP; k < p; k++)
             {
-                TSol ind = CreateInitialSolutions();
-                ind = Decoder(ind,n,node, dist, vehicle, nbVehicles, nbUsers, periodLength, H, oDepotIDs, fDepotIDs, cStations, maxRideTimes, weights, elecPrices, cons);
-                Pop[k] = PopInter[k] = ind;
+                TSol& ind = decodeSol;
+                CreateInitialSolutions(ind);
+                DecodeIndividual(ind, false, INFINITY, nullptr, nullptr); // a random chromosome is rarely an elite parent, so no trace
+                Pop.store(k, ind);
+                Pop.trace[k].decoder = 0;
+                rankOrder.push_back(k);
 
                 // save the best solution found in this run
-                updateBestSolution(Pop[k]);
+                updateBestSolution(ind);
             }
         }
+        PopInter.resize(p, n+1);
+
+        // find the elite set of the new population size and elite fraction
+        RankPopulation((int)(p*pe));
+
+        // a pruned offspring only has a bound on its fitness: it is decoded fully before it can be elite
+        bool redecoded = false;
+        for (int i=0; i<(int)(p*pe); i++)
+        {
+            if (Pop.fo[rankOrder[i]] < INFINITY) continue;
+            TSol& ind = decodeSol;
+            Individual(Pop, rankOrder[i], ind);
+            DecodeIndividual(ind, false, INFINITY, nullptr, &Pop.trace[rankOrder[i]]);
+            Pop.store(rankOrder[i], ind);
+            updateBestSolution(ind);
+            redecoded = true;
+        }
+        if (redecoded) RankPopulation((int)(p*pe));
 
         // The 'pe' best chromosomes are maintained, so we just copy these into PopInter:
         #pragma omp parallel for num_threads(MAX_THREADS)
         for (int i=0; i<(int)(p*pe); i++)
         {
-            // copy the chromosome for next generation
-            PopInter[i] = Pop[i];
+            // copy the chromosome for next generation (with its decode trace, the offspring resume from it)
+            PopInter.move(i, Pop, rankOrder[i]);
         }
 
         // We'll mate 'p - pe - pm' pairs; initially, i = pe, so we need to iterate until i < p - pm:
         averageOffspring = 0;
         bestOffspring = INFINITY;
+        int numDecoded = 0;                 // offspring decoded fully (the fo of a pruned one is only a bound)
 
-        // #pragma omp parallel for num_threads(MAX_THREADS) ** posso ter problemas devido a todas threads acessar a mesma variavel
+        // an offspring worse than the worst elite cannot enter the elite set, so its decoding may stop there (the bound needs the triangle inequality)
+        double eliteBound = Pop.fo[rankOrder[(int)(p*pe) - 1]];
+        double pruneBound = (prune && problem.metric) ? eliteBound : INFINITY;
+
+        // each thread draws its parents from its own random stream and sums its own offspring statistics
+        #pragma omp parallel for num_threads(MAX_THREADS) schedule(static) reduction(+:averageOffspring,numDecoded,numPruned) reduction(min:bestOffspring)
         for (int i = (int)(p*pe); i < p - (int)(p*pm); i++)
         {
             // Parametric uniform crossover            
-            PopInter[i] = ParametricUniformCrossover((int)(p*pe));
-            PopInter[i] = Decoder(PopInter[i], n, node, dist, vehicle, nbVehicles, nbUsers, periodLength, H, oDepotIDs, fDepotIDs, cStations, maxRideTimes, weights, elecPrices, cons);
+            int parent = ParametricUniformCrossover((int)(p*pe), PopInter[i]);
+            PopInter.flag[i] = 0;   // set the flag of local search as zero
+            TSol& ind = decodeSol;
+            Individual(PopInter, i, ind);
+            DecodeIndividual(ind, false, pruneBound, &PopInter.trace[parent], &decodeTrace); // routes that start like in the elite parent resume from its trace
+
+            // only an offspring that enters the elite set of this generation keeps its trace (elite parents are the only ones resumed from)
+            if (ind.fo < eliteBound) std::swap(PopInter.trace[i], decodeTrace);
+            else PopInter.trace[i].decoder = 0;
+            if (ind.dominated)
+            {
+                // ranked behind all decoded chromosomes and left out of the offspring statistics
+                numPruned++;
+                ind.fo = INFINITY;
+                PopInter.store(i, ind);
+                continue;
+            }
+            PopInter.store(i, ind);
 
             // save the best solution found in this run
-            updateBestSolution(PopInter[i]);
+            updateBestSolution(ind);
 
-            averageOffspring += PopInter[i].fo;
+            averageOffspring += ind.fo;
+            numDecoded++;
 
-            if (PopInter[i].fo < bestOffspring)
-                bestOffspring = PopInter[i].fo;
+            if (ind.fo < bestOffspring)
+                bestOffspring = ind.fo;
         }
 
         // update average offspring fitness of last generation
@@ -253,28 +315,31 @@ void BRKGA()
         }
 
         // calculate average offspring fitness of current generation
-        averageOffspring = (averageOffspring)/(p - (int)(p*pe) - (int)(p*pm));
+        averageOffspring = (averageOffspring)/std::max(numDecoded, 1);
 
         if (numGenerations == 1){
             lastAvgOffspring = averageOffspring;
         }
         
         // We'll introduce 'pm' mutants:
-        //#pragma omp parallel for num_threads(MAX_THREADS)
+        #pragma omp parallel for num_threads(MAX_THREADS) schedule(static)
         for (int i = p - (int)(p*pm) - (int)(p*pe); i < p; i++)
         {
-            PopInter[i] = CreateInitialSolutions();
-            PopInter[i] = Decoder(PopInter[i], n, node, dist, vehicle, nbVehicles, nbUsers, periodLength, H, oDepotIDs, fDepotIDs, cStations, maxRideTimes, weights, elecPrices, cons);
+            TSol& ind = decodeSol;
+            CreateInitialSolutions(ind);
+            DecodeIndividual(ind, false, INFINITY, nullptr, nullptr); // a mutant is rarely an elite parent, so no trace
+            PopInter.store(i, ind);
+            PopInter.trace[i].decoder = 0;
 
             // save the best solution found in this run
-            updateBestSolution(PopInter[i]);
+            updateBestSolution(ind);
         }  
         
-        // Update the current population
-        Pop = PopInter;   
-
-        // Sort population in increase order of fitness
-        sort(Pop.begin(), Pop.end(), sortByFitness);
+        // Update the current population (swap the buffers) and rank it in increase order of fitness
+        Pop.swap(PopInter);
+        rankOrder.resize(p);
+        iota(rankOrder.begin(), rankOrder.end(), 0);
+        RankPopulation((int)(p*pe));
 
         // Verify if we improve the best fitness found until now and set the reward
         double gap = (bestOffspring - bestFitness)/bestFitness;
@@ -314,24 +379,27 @@ void BRKGA()
 
 	            for (int i=0; i < (int)(p*pe); i++)
 	            {
-	                if (Pop[i].promising == 1)
+	                if (Pop.promising[rankOrder[i]] == 1)
 	                {
-	                	promisingSol.push_back(i);
+	                	promisingSol.push_back(rankOrder[i]);
 	                }
 	            }
 
 	            #pragma omp parallel for num_threads(MAX_THREADS)
 		    for (unsigned int i=0; i < promisingSol.size(); i++)
 		    {
-			    // local search not influence the evolutionary process
-			    TSol s = LocalSearch(Pop[promisingSol[i]], n, node, dist, vehicle, nbVehicles, nbUsers, periodLength, H, oDepotIDs, fDepotIDs, cStations, maxRideTimes, weights, elecPrices, cons);
+			    // local search not influence the evolutionary process (the population keeps keys only, so decode the solution again)
+			    TSol& s = decodeSol;
+			    Individual(Pop, promisingSol[i], s);
+			    DecodeIndividual(s, true, INFINITY, &Pop.trace[promisingSol[i]], nullptr);
+			    s = LocalSearch(std::move(s), n, problem);
                 s.flag = 1; // To know afterwards whether this solution came from LS or not
-                //if (s.fo < Pop[promisingSol[i]].fo) { nbTimesLSImprovedSol++; } // FOR TESTING PURPOSES
+                //if (s.fo < Pop.fo[promisingSol[i]]) { nbTimesLSImprovedSol++; } // FOR TESTING PURPOSES
 			    updateBestSolution(s);
 			    numLS++;
 
 			    // set flag as 1 to prevent new local search in the same solution
-			    Pop[promisingSol[i]].flag = 1;
+			    Pop.flag[promisingSol[i]] = 1;
 		     }
 		     promisingSol.clear();
 	        }
@@ -344,21 +412,27 @@ void BRKGA()
             #pragma omp parallel for num_threads(MAX_THREADS)
             for (int i=0; i<p; i++)
             {
-                TSol ind = CreateInitialSolutions(); 
-                ind = Decoder(ind, n, node, dist, vehicle, nbVehicles, nbUsers, periodLength, H, oDepotIDs, fDepotIDs, cStations, maxRideTimes, weights, elecPrices, cons);
-                Pop[i] = ind;
+                TSol& ind = decodeSol;
+                CreateInitialSolutions(ind);
+                DecodeIndividual(ind, false, INFINITY, nullptr, &PopInter.trace[i]);
+                PopInter.store(i, ind);
 
                 // save the best solution found in this run
-                updateBestSolution(Pop[i]);
+                updateBestSolution(ind);
             }
-            sort(Pop.begin(), Pop.end(), sortByFitness);
-            bestFitness = Pop[0].fo;
+            Pop.swap(PopInter);
+            iota(rankOrder.begin(), rankOrder.end(), 0);
+            RankPopulation((int)(p*pe));
+            bestFitness = Pop.fo[rankOrder[0]];
 
             if (debug)
                 printf("\n\nRestart...\n\n");
         }
 
 
+        // collect the best solution of the threads
+        MergeBestSolutions();
+
         // print screen
         if (debug){
             printf("\nGeneration: %3d [%4d - %3d(%.2lf) (%3d) - %3d(%.2lf) - (%.2lf)] \t %.2lf  \t %.2lf [%.4lf] \t %.2lf",
@@ -383,6 +457,14 @@ void BRKGA()
         }
     }
 
+#ifdef FITNESS_CACHE
+    if (debug) printf("\nFitness cache: %lld hits, %lld misses\n", fitnessCache.hits, fitnessCache.misses);
+#endif
+    if (debug && prune) printf("\nPruned offspring: %lld\n", numPruned);
+    long long scheduleHits, scheduleMisses;
+    TakeScheduleCacheCounts(scheduleHits, scheduleMisses);
+    if (debug && ls) printf("\nSchedule cache: %lld routes reused, %lld scheduled\n", scheduleHits, scheduleMisses);
+
     // print Q-Table
     if(debug) printf("\nQ-Table:");
     for (int q=0; q<Q.size() && debug; q++)
@@ -401,17 +483,66 @@ void BRKGA()
     // free memory
     Pop.clear();
     PopInter.clear();
+    rankOrder.clear();
     Q.clear();
 }
 
-void updateBestSolution(TSol s)
+void DecodeIndividual(TSol& s, bool withRoutes, double bound, const TDecodeTrace* parent, TDecodeTrace* trace)
 {
-    // save the best solution found in this run
-    if (s.fo < bestSolution.fo)
+#ifdef FITNESS_CACHE
+    // the part of the keys the decoder reads
+    static thread_local std::vector <int> signature;
+    DecodeSignature(s.vec, n, problem, portfolio, signature);
+
+    // a cached solution was already offered to updateBestSolution, so its routes are only needed if asked for (or if it would still be a new best)
+    if (fitnessCache.Lookup(signature, s, withRoutes, bestFo.load(std::memory_order_relaxed), portfolio)) {
+        if (trace != nullptr) trace->decoder = 0;
+        return;
+    }
+
+    s = Decoder(std::move(s), n, problem, bound, parent, trace, portfolio);
+    if (!s.dominated) fitnessCache.Store(signature, s, withRoutes); // the fo of a pruned decoding is only a bound
+#else
+    s = Decoder(std::move(s), n, problem, bound, parent, trace, portfolio);
+#endif
+}
+
+void RankPopulation(int Tpe)
+{
+    // only the boundary of the elite set matters for the other chromosomes
+    nth_element(rankOrder.begin(), rankOrder.begin() + Tpe, rankOrder.end(), sortByFitness);
+
+    // the elite set is kept in increase order of fitness
+    sort(rankOrder.begin(), rankOrder.begin() + Tpe, sortByFitness);
+}
+
+void updateBestSolution(const TSol& s)
+{
+    // save the best solution found in this run (only the thread that lowers bestFo copies s)
+    double best = bestFo.load(std::memory_order_relaxed);
+    while (s.fo < best)
     {
-        bestSolution = s;
-        CPUbest = clock();
-        //gettimeofday(&Tbest, NULL);
+        if (bestFo.compare_exchange_weak(best, s.fo, std::memory_order_relaxed))
+        {
+            int thread = omp_get_thread_num();
+            threadBest[thread] = s;
+            threadBestTime[thread] = clock();
+            //gettimeofday(&Tbest, NULL);
+            break;
+        }
+    }
+}
+
+void MergeBestSolutions()
+{
+    for (unsigned t = 0; t < threadBest.size(); t++)
+    {
+        if (threadBest[t].fo < bestSolution.fo)
+        {
+            bestSolution = threadBest[t];
+            CPUbest = threadBestTime[t];
+        }
+        threadBest[t].fo = INFINITY;
     }
 }
 
@@ -683,41 +814,26 @@ void UpdateQTable()
     //printf("%.3lf \n", qTotal);
 }
 
-TSol CreateInitialSolutions()
+void CreateInitialSolutions(TSol& s)
 {
-	TSol s;
-	TVecRk aux;
-
-        s.vec.clear();
+        s.vec.resize(n+1);
 
 	// create a random-key for each allelo (consider decoder type in the n-th random-key)
 	for (int j = 0; j < n+1; j++)
 	{
-		aux.rk  = randomico(0,1);
-        if (j < 2*nbUsers) { // Pickup or dropoff gene
-            aux.user = j;
-        }
-        else if (j < 2*nbUsers+nbVehicles) { // vehicle genes
-            aux.user = j-2*nbUsers;
-        }
-        else {
-            aux.user = -1;
-        }
-        s.vec.push_back(aux);
+        s.vec[j] = randomico(0,1);
 	}
     
-    // Initialize empty solution
-    std::vector<TVecSol> tempRoute(0);
-    std::vector<std::vector<TVecSol>> tempSol(nbVehicles, tempRoute);
-    s.sol = tempSol;
+    // Initialize empty solution (the routes keep their storage)
+    s.sol.resize(problem.nbVehicles);
+    for (TRoute& route : s.sol) route.clear();
 
     // flag to control the local search memory
     s.flag = 0;
 
     // Set infeasibility indicators to 0
     s.battery_infeasibles = 0;
-
-   return s;
+    s.scheduled = false;
 }
 
 TSol Perturbation(TSol s, double beta) // Not used
@@ -732,56 +848,54 @@ TSol Perturbation(TSol s, double beta) // Not used
         } while(pos1 == pos2);
 
         // swap genes pos1 e pos2
-        double temp = s.vec[pos1].rk;
-        s.vec[pos1].rk = s.vec[pos2].rk;
-        s.vec[pos2].rk = temp;
+        TKey temp = s.vec[pos1];
+        s.vec[pos1] = s.vec[pos2];
+        s.vec[pos2] = temp;
     }
     return s;
 }
 
-TSol ParametricUniformCrossover(int Tpe)
-{	
-    TSol s;
+void Individual(const TPopulation& pop, int i, TSol& s)
+{
+    // copy the random keys of the individual
+    s.vec.assign(pop[i], pop[i] + pop.nbGenes);
+
+    // Initialize empty solution (the routes keep their storage)
+    s.sol.resize(problem.nbVehicles);
+    for (TRoute& route : s.sol) route.clear();
+
+    // flag to control the local search memory
+    s.flag = pop.flag[i];
 
-    // create a new offspring
-    s.vec.resize(n+1);
+    // Set infeasibility indicators to 0
+    s.battery_infeasibles = 0;
+    s.scheduled = false;
+}
 
+int ParametricUniformCrossover(int Tpe, TKey* offspring)
+{	
     // Select an elite parent:
     int eliteParent = irandomico(0,Tpe - 1);
 
     // Select a non-elite parent:
     int noneliteParent = Tpe + irandomico(0, p - Tpe - 1);
 
+    const TKey* elite = Pop[rankOrder[eliteParent]];
+    const TKey* nonelite = Pop[rankOrder[noneliteParent]];
+
     // Mate:  // including decoder in the n-th rk 
     for(int j = 0; j < n+1; j++)
     {
         //copy alelos of top chromossom of the new generation
         if (randomico(0,1) < rhoe)
-           s.vec[j].rk = Pop[eliteParent].vec[j].rk;
-        else
-           s.vec[j].rk = Pop[noneliteParent].vec[j].rk;
-
-        // "Clean" users
-        if (j < 2*nbUsers)
-        	s.vec[j].user = j;
-        else if (j < 2*nbUsers + nbVehicles)
-            s.vec[j].user = j - 2*nbUsers;
+           offspring[j] = elite[j];
         else
-        	s.vec[j].user = -1; // User ID = -1 for the rk's relating to scheduler and decoder
-
-        // Initialize empty solution
-        std::vector<TVecSol> tempRoute(0);
-        std::vector<std::vector<TVecSol>> tempSol(nbVehicles, tempRoute);
-        s.sol = tempSol;
+           offspring[j] = nonelite[j];
     }
-
-    // set the flag of local search as zero
-    s.flag = 0;
-
-    return s;
+    return eliteParent;
 }
 
-double PearsonCorrelation(std::vector <TVecRk> X, std::vector <TVecRk> Y)
+double PearsonCorrelation(const TKey* X, const TKey* Y)
 {
     double correlation = 0;
     double sumXY = 0;
@@ -792,11 +906,11 @@ double PearsonCorrelation(std::vector <TVecRk> X, std::vector <TVecRk> Y)
 
     for(int j=0; j<n-2; j++)
     {
-        sumX += X[j].rk;
-        sumX2 += X[j].rk * X[j].rk;
-        sumXY += X[j].rk * Y[j].rk;
-        sumY += Y[j].rk;
-        sumY2 += Y[j].rk * Y[j].rk;
+        sumX += X[j];
+        sumX2 += X[j] * X[j];
+        sumXY += X[j] * Y[j];
+        sumY += Y[j];
+        sumY2 += Y[j] * Y[j];
     }
 
     //Pearson
@@ -812,13 +926,13 @@ void writeLPGraph(std::vector<std::vector<std::pair<int, double> > > &listaArest
 	int newId = 1;
 	std::vector<int> newIds(n, 0);
 	for (i = 0; i < n; i++) {
-		if (newIds[Pop[i].label] == 0) {
-			newIds[Pop[i].label] = newId;
+		if (newIds[Pop.label[rankOrder[i]]] == 0) {
+			newIds[Pop.label[rankOrder[i]]] = newId;
 			newId++;
 		}
 	}
 	for (i = 0; i < n; i++) {
-		Pop[i].label = newIds[Pop[i].label];
+		Pop.label[rankOrder[i]] = newIds[Pop.label[rankOrder[i]]];
 	}
 
 	// Dá um nome ao arquivo .json (LP-<generation>.json)
@@ -833,9 +947,9 @@ void writeLPGraph(std::vector<std::vector<std::pair<int, double> > > &listaArest
 	for (i = 0; i < listaArestas.size(); i++) {			
 		totalArestas += listaArestas[i].size();
 		if(i == listaArestas.size() - 1)
-			json += "    {\"id\": \"" + std::to_string(i) + "\", \"group\": " + std::to_string(Pop[i].label) + "}\n";
+			json += "    {\"id\": \"" + std::to_string(i) + "\", \"group\": " + std::to_string(Pop.label[rankOrder[i]]) + "}\n";
 		else
-			json += "    {\"id\": \"" + std::to_string(i) + "\", \"group\": " + std::to_string(Pop[i].label) + "},\n";
+			json += "    {\"id\": \"" + std::to_string(i) + "\", \"group\": " + std::to_string(Pop.label[rankOrder[i]]) + "},\n";
 	}
 	totalArestas /= 2;
 	json += "  ],\n";
@@ -927,7 +1041,7 @@ void IC(int Tpe)
 	for (int i = 0; i < Tpe - 1; i++) {
 		for (int j = i + 1; j < Tpe; j++)
 		{
-			pearson = PearsonCorrelation(Pop[i].vec, Pop[j].vec);
+			pearson = PearsonCorrelation(Pop[rankOrder[i]], Pop[rankOrder[j]]);
 			if (pearson > 0.7) {
 				entrouAresta++;
 				listaArestas[i].push_back(std::make_pair(j, pearson));
@@ -953,7 +1067,7 @@ void LP(std::vector<std::vector<std::pair<int, double> > > listaArestas)
 
 	// initialize each node with its own label
 	for (int i = 0; i < nk; i++)
-		Pop[i].label = i;
+		Pop.label[rankOrder[i]] = i;
 
 	int iteracao = 1;
 	int labelVizinho, melhorLabel;
@@ -970,7 +1084,7 @@ void LP(std::vector<std::vector<std::pair<int, double> > > listaArestas)
 			// Calcula o peso para os labels
 			totalLabels.clear();
 			for (auto idVizinho : listaArestas[idVertice]) {
-				labelVizinho = Pop[idVizinho.first].label;
+				labelVizinho = Pop.label[rankOrder[idVizinho.first]];
 				it = totalLabels.find(labelVizinho);
 				if (it != totalLabels.end()) {
 					it->second += idVizinho.second;
@@ -981,7 +1095,7 @@ void LP(std::vector<std::vector<std::pair<int, double> > > listaArestas)
 			}
 
 			// Melhor label é ele mesmo inicialmente
-			melhorLabel = Pop[idVertice].label;
+			melhorLabel = Pop.label[rankOrder[idVertice]];
 			melhorPeso = std::numeric_limits<double>::min();
 			for (auto totais : totalLabels) {
 				if (totais.second > melhorPeso) {
@@ -990,8 +1104,8 @@ void LP(std::vector<std::vector<std::pair<int, double> > > listaArestas)
 				}
 			}
 
-			if (melhorLabel != Pop[idVertice].label) {
-				Pop[idVertice].label = melhorLabel;
+			if (melhorLabel != Pop.label[rankOrder[idVertice]]) {
+				Pop.label[rankOrder[idVertice]] = melhorLabel;
 				movimentos = 1;
 			}
 		}
@@ -1007,7 +1121,7 @@ void PromisingLP(int Tpe)
 
 	// initialize promisings solutions
 	for (int i = 0; i < Tpe; i++)
-		Pop[i].promising = 0;
+		Pop.promising[rankOrder[i]] = 0;
 
 	// save labels defined by LP in groups
 	int achei;
@@ -1017,13 +1131,13 @@ void PromisingLP(int Tpe)
 		achei = 0;
 		for (unsigned int j = 0; j < grupos.size(); j++)
 		{
-			if (Pop[i].label == grupos[j])
+			if (Pop.label[rankOrder[i]] == grupos[j])
 				achei = 1;
 		}
 		if (achei == 0)
 		{
 			tamanhoGrupos++;
-			grupos.push_back(Pop[i].label);
+			grupos.push_back(Pop.label[rankOrder[i]]);
 		}
 	}
 
@@ -1035,16 +1149,16 @@ void PromisingLP(int Tpe)
 		int local = -1;
 		for (int i = 0; i < Tpe; i++)
 		{
-			if (Pop[i].label == grupos[j])
+			if (Pop.label[rankOrder[i]] == grupos[j])
 			{
 				// find the best solution of the group
 				if (local == -1)
 					local = i;
 
 				// we not apply local search in this solution yet
-                		if (Pop[i].fo < menorFO && Pop[i].flag == 0) 
+                		if (Pop.fo[rankOrder[i]] < menorFO && Pop.flag[rankOrder[i]] == 0) 
 				{
-					menorFO = Pop[i].fo;
+					menorFO = Pop.fo[rankOrder[i]];
 					localMenor = i;
 				}
 			}
@@ -1053,8 +1167,8 @@ void PromisingLP(int Tpe)
 		if (localMenor == -1)
 			localMenor = local;
 
-		if (Pop[localMenor].label != -1)
-			Pop[localMenor].promising = 1;
+		if (Pop.label[rankOrder[localMenor]] != -1)
+			Pop.promising[rankOrder[localMenor]] = 1;
 	}
 }
 
@@ -1063,12 +1177,13 @@ void FreeMemory()
     //methods
     Pop.clear();
     PopInter.clear();
+    rankOrder.clear();
     Q.clear();
 }
 
 double randomico(double min, double max)
 {
-    return ((double)(rand()%10000)/10000.0)*(max-min)+min;
+    return ((double)(ThreadRand()%10000)/10000.0)*(max-min)+min;
     //return uniform_real_distribution<double>(min, max)(rng);
 }
 
@@ -1077,7 +1192,13 @@ int irandomico(int min, int max)
     return (int)randomico(0,max-min+1.0) + min;
 }
 
-void splitF0(TSol& s, std::vector <TNode>& node, std::vector <std::vector <double> >& dist, int nbVehicles, int nbUsers, int periodLength, std::vector <int> maxRideTimes, double weights[3], std::vector <double> elecPrices) {
+void splitF0(TSol& s, const TProblem& problem) {
+    const std::vector <TNode>& node = problem.node;
+    const TMatrix& dist = problem.dist;
+    const TPriceTable& prices = problem.prices;
+    int nbVehicles = problem.nbVehicles;
+    int nbUsers = problem.nbUsers;
+
     double TRT = 0; // Total Ride Time
     double ERT = 0; // Excess Ride Time
     double CC = 0;  // Charging cost
@@ -1085,8 +1206,6 @@ void splitF0(TSol& s, std::vector <TNode>& node, std::vector <std::vector <doubl
     std::vector <double> URTs; // User Ride Times
     int currStop = -1;
     int nextStop = -1;
-    int startPeriod;
-    int endPeriod;
 
     for (int u = 0; u < nbUsers; u++) { // Initialize User Ride Times by substracting service time already
         URTs.push_back(-1 * node[u].d);
@@ -1109,25 +1228,8 @@ void splitF0(TSol& s, std::vector <TNode>& node, std::vector <std::vector <doubl
                 URTs[currStop - nbUsers] += s.sol[v][i].T; // Add start-time of service at pick-up
             }
             else { // Else, current stop is a charging station
-                // Find period in which charging starts and ends
-                startPeriod = floor(s.sol[v][i].T / periodLength);
-                endPeriod = floor((s.sol[v][i].T + s.sol[v][i].w) / periodLength);
-                if (endPeriod == elecPrices.size()) { endPeriod = endPeriod - 1; }  // This is to prevent subscript errors when charging ends exactly at the time horizon -> floor function above acts as if charging ends after H, while it ends just at H (possible because charging stations can coincide with destination depots)
-                if (startPeriod == elecPrices.size()) { startPeriod = startPeriod - 1; } // Similar but for case where 'charging' starts at H (nonsensical case but possible because charging stations can coincide
-                // If whole session in 1 period
-                if (startPeriod == endPeriod) {
-                    CC += s.sol[v][i].w * elecPrices[startPeriod];
-                }
-                else {
-                    // Calculate cost during first and last period
-                    CC += ((startPeriod + 1) * periodLength - s.sol[v][i].T) * elecPrices[startPeriod];
-                    CC += (s.sol[v][i].T + s.sol[v][i].w - endPeriod * periodLength) * elecPrices[endPeriod];
-                    // Calculate cost for inbetween periods
-                    for (int j = startPeriod + 1; j < endPeriod; j++) {
-                        CC += periodLength * elecPrices[j];
-                    }
-                }
-
+                // Price of the charging session over the periods it spans
+                CC += prices.Cost(s.sol[v][i].T, s.sol[v][i].w);
             }
         }
     }
@@ -12,6 +12,7 @@
 #include <cstring>
 #include <string.h>
 #include <omp.h>
+#include <atomic>
 #include <algorithm>
 #include <time.h>
 #include <utility>  // pair
@@ -25,6 +26,7 @@
 #include <fstream> //graph
 
 #include "Data.h"
+#include "FitnessCache.h"
 #include "Define.h"
 #include "Read.h"
 #include "Decoder.h"
@@ -42,9 +44,17 @@ void BRKGA();
 
 /************************************************************************************
  Method: updateBestSolution()
- Description: Update the best solution found during the run
+ Description: Update the best solution found during the run. Safe to call from parallel
+ loops: s is only compared to the atomic bestFo, and copied (into the slot of the
+ calling thread) if it improves it. bestSolution is updated by MergeBestSolutions().
 *************************************************************************************/
-void updateBestSolution(TSol s);
+void updateBestSolution(const TSol& s);
+
+/************************************************************************************
+ Method: MergeBestSolutions()
+ Description: Copy the best of the thread slots into bestSolution and CPUbest (serial code)
+*************************************************************************************/
+void MergeBestSolutions();
 
 /************************************************************************************
  Method: InitiateQTable()
@@ -66,9 +76,9 @@ void UpdateQTable();
 
 /************************************************************************************
  Method: CREATE INITIAL SOLUTIONS
- Description: create a initial chromossom with random keys
+ Description: create a initial chromossom with random keys in s (an empty solution)
 *************************************************************************************/
-TSol CreateInitialSolutions();
+void CreateInitialSolutions(TSol& s);
 
 /************************************************************************************
  Method: PERTURBATION
@@ -76,17 +86,41 @@ TSol CreateInitialSolutions();
 *************************************************************************************/
 TSol Perturbation(TSol s, double beta);
 
+/************************************************************************************
+ Method: INDIVIDUAL
+ Description: fill s with an undecoded solution from the keys of individual i of pop
+*************************************************************************************/
+void Individual(const TPopulation& pop, int i, TSol& s);
+
+/************************************************************************************
+ Method: DECODE INDIVIDUAL
+ Description: decode the undecoded solution s, stopping once its fitness cannot get below
+ bound (INFINITY to decode fully). With -DFITNESS_CACHE, take its fitness from fitnessCache
+ if a chromosome with the same decode signature was decoded before (the routes only if withRoutes,
+ and with portfolio the charging priority and scheduler keys it was given).
+ parent and trace are passed on to Decoder (trace is emptied on a cache hit)
+*************************************************************************************/
+void DecodeIndividual(TSol& s, bool withRoutes, double bound, const TDecodeTrace* parent, TDecodeTrace* trace);
+
+/************************************************************************************
+ Method: RANK POPULATION
+ Description: order rankOrder so that it starts with the Tpe best rows of Pop in
+ increase order of fitness (the other rows are not sorted)
+*************************************************************************************/
+void RankPopulation(int Tpe);
+
 /************************************************************************************
  Method: PARAMETRICUNIFORMCROSSOVER
- Description: create a new offspring with parametric uniform crossover
+ Description: create a new offspring with parametric uniform crossover in offspring, returns
+ the rank of its elite parent (its row in PopInter once the elite set is copied there)
 *************************************************************************************/
-TSol ParametricUniformCrossover(int Tpe);
+int ParametricUniformCrossover(int Tpe, TKey* offspring);
 
 /************************************************************************************
  Method: PEARSON CORRELATION
  Description: calculate the Pearson correlation coefficient between two chromossoms
 *************************************************************************************/
-double PearsonCorrelation(std::vector <TVecSol> s1, std::vector <TVecSol> s2);
+double PearsonCorrelation(const TKey* X, const TKey* Y);
 
 /************************************************************************************
  Metodo: IC(TSol Pop)
@@ -127,13 +161,13 @@ void WriteResults(double fo, double foAverage, std::vector <double> fos, std::ve
 Method: WRITE SOLUTION
 Description: write the solution in .TXT file
 *************************************************************************************/
-void WriteSolution(TSol s, int n, float timeBest, float timeTotal, char instance[]);
+void WriteSolution(const TSol& s, int n, float timeBest, float timeTotal, char instance[], const TProblem& problem);
 
 /************************************************************************************
 Method: WRITE SOLUTION SCREEN
 Funcao: write the solution in the screen
 *************************************************************************************/
-void WriteSolutionScreen(TSol s, int n, float timeBest, float timeTotal, char instance[], int nbVehicles);
+void WriteSolutionScreen(const TSol& s, int n, float timeBest, float timeTotal, char instance[], const TProblem& problem);
 
 /************************************************************************************
  Method: RANDOMICO
@@ -147,6 +181,6 @@ double randomico(double min, double max);
 *************************************************************************************/
 int irandomico(int min, int max);
 
-void splitF0(TSol& s, std::vector <TNode>& node, std::vector <std::vector <double> >& dist, int nbVehicles, int nbUsers, int periodLength, std::vector <int> maxRideTimes, double weights[3], std::vector <double> elecPrices);
+void splitF0(TSol& s, const TProblem& problem);
 
 #endif
\ No newline at end of file
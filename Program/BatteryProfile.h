@@ -0,0 +1,144 @@
+//#pragma once
+#ifndef _BATTERYPROFILE_H
+#define _BATTERYPROFILE_H
+
+#include <vector>
+#include <algorithm>
+#include <math.h>
+
+/************************************************************************************
+ Struct: TBatteryProfile
+ Description: battery levels of a route while Scheduler() inserts its charging stations.
+ Stop j of the route as it was before the insertions is slot 2j, a station inserted after
+ it is slot 2j+1 (slots without a station are empty). A station only changes the levels
+ of the slots after it, so the updates are suffix adds: the levels are kept as a base per
+ slot plus a Fenwick tree of the adds, the highest level after charging (B + w*alpha) in a
+ max segment tree with lazy adds, and the consumption of the detours to the stations in a
+ second Fenwick tree; each operation is O(log n). Kept per thread.
+*************************************************************************************/
+struct TBatteryProfile
+{
+    int slots = 0;                              // 2 x stops of the route
+    int leaves = 0;                             // slots rounded up to a power of two
+    std::vector <double> base;                  // level of each slot without the adds made before it was set
+    std::vector <double> added;                 // Fenwick tree: adds to the levels from a slot onward
+    std::vector <double> detours;               // Fenwick tree: detour consumption of the station in a slot
+    std::vector <double> peak;                  // segment tree: max of the charged levels (-INFINITY if empty)
+    std::vector <double> pending;               // adds not yet passed to the children of an inner node
+
+    // Empties the profile for a route of size stops
+    void Reset(int size)
+    {
+        slots = 2 * size;
+        leaves = 1;
+        while (leaves < slots) leaves *= 2;
+        base.assign(slots, 0.0);
+        added.assign(slots + 1, 0.0);
+        detours.assign(slots + 1, 0.0);
+        peak.assign(2 * leaves, -INFINITY);
+        pending.assign(leaves, 0.0);
+    }
+
+    // Battery level B of slot k
+    double Level(int k) const
+    {
+        return base[k] + Prefix(added, k);
+    }
+
+    // Sets slot k to battery level B, charged is B + w*alpha
+    void Set(int k, double B, double charged)
+    {
+        base[k] = B - Prefix(added, k);
+        int p = k + leaves;
+        Push(p);
+        peak[p] = charged;
+        Pull(p);
+    }
+
+    // Highest charged level of the slots from k on
+    double Peak(int k)
+    {
+        double best = -INFINITY;
+        int l = k + leaves;
+        int r = 2 * leaves;
+        Push(l);
+        Push(r - 1);
+        for (; l < r; l >>= 1, r >>= 1) {
+            if (l & 1) best = std::max(best, peak[l++]);
+            if (r & 1) best = std::max(best, peak[--r]);
+        }
+        return best;
+    }
+
+    // Adds delta to the levels of the slots from k on
+    void Add(int k, double delta)
+    {
+        if (k >= slots) return;
+        Increase(added, k, delta);
+        int l = k + leaves;
+        int r = 2 * leaves;
+        for (int a = l, b = r; a < b; a >>= 1, b >>= 1) {
+            if (a & 1) Apply(a++, delta);
+            if (b & 1) Apply(--b, delta);
+        }
+        Pull(l);
+        Pull(r - 1);
+    }
+
+    // Records the detour consumption of the station in slot k
+    void AddDetour(int k, double consumption)
+    {
+        Increase(detours, k, consumption);
+    }
+
+    // Detour consumption of the stations in the slots from k on
+    double Detours(int k) const
+    {
+        return Prefix(detours, slots - 1) - (k > 0 ? Prefix(detours, k - 1) : 0.0);
+    }
+
+private:
+    static void Increase(std::vector <double>& tree, int k, double delta)
+    {
+        for (k++; k < (int)tree.size(); k += k & -k) tree[k] += delta;
+    }
+
+    static double Prefix(const std::vector <double>& tree, int k)
+    {
+        double sum = 0;
+        for (k++; k > 0; k -= k & -k) sum += tree[k];
+        return sum;
+    }
+
+    void Apply(int p, double delta)
+    {
+        peak[p] += delta;
+        if (p < leaves) pending[p] += delta;
+    }
+
+    // Passes the pending adds of the ancestors of leaf p down to it
+    void Push(int p)
+    {
+        int height = 0;
+        while ((1 << height) < leaves) height++;
+        for (int h = height; h > 0; h--) {
+            int q = p >> h;
+            if (pending[q] != 0) {
+                Apply(2 * q, pending[q]);
+                Apply(2 * q + 1, pending[q]);
+                pending[q] = 0;
+            }
+        }
+    }
+
+    // Recomputes the ancestors of leaf p
+    void Pull(int p)
+    {
+        while (p > 1) {
+            p >>= 1;
+            peak[p] = std::max(peak[2 * p], peak[2 * p + 1]) + pending[p];
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,152 @@
+//#pragma once
+#ifndef _CHARGERCALENDAR_H
+#define _CHARGERCALENDAR_H
+
+#include <vector>
+#include <algorithm>
+#include <math.h>
+
+/************************************************************************************
+ Struct: TChargerCalendar
+ Description: charger reservations of the charging stations during one schedule. A session
+ from start to end occupies the whole minutes between them, [ceil(start), floor(end)), cut to
+ the horizon [0, horizon). Each station keeps its load as a step function: sorted steps
+ (time, number of chargers in use from time until the next step), so a query is a binary
+ search for start followed by a sweep over the steps the session overlaps. Reset() is O(1):
+ a station is only cleared when it is next used in a later epoch. While log is set, queries
+ and reservations are appended to it, and Replay() repeats them on another state of the
+ calendar (see TScheduleCache). Kept per thread.
+*************************************************************************************/
+struct TChargerCalendar
+{
+    struct TStep
+    {
+        int time;
+        int load;
+    };
+
+    struct TEvent
+    {
+        int cs;
+        float start;
+        float end;
+        int cap;
+        int fits;                               // answer of a Fits() query, -1 for a reservation
+    };
+
+    struct TStation
+    {
+        unsigned long long epoch = 0;           // epoch of the reservations in steps
+        std::vector <TStep> steps;              // steps[0].time == 0
+    };
+
+    std::vector <TStation> stations;
+    unsigned long long epoch = 0;
+    int horizon = 0;                            // minutes, end of the last price period
+    std::vector <TEvent>* log = nullptr;        // if set, receives the queries and reservations
+
+    // Drops all reservations
+    void Reset(int nbStations, int horizonLength)
+    {
+        if ((int)stations.size() != nbStations) stations.resize(nbStations);
+        horizon = horizonLength;
+        epoch++;
+    }
+
+    // Returns true if a session from start to end at station cs never needs more than cap chargers
+    bool Fits(int cs, float start, float end, int cap)
+    {
+        bool fits = true;
+        int a, b;
+        if (Minutes(start, end, a, b)) {
+            const std::vector <TStep>& steps = Station(cs).steps;
+            for (int k = Find(steps, a); k < (int)steps.size() && steps[k].time < b; k++) {
+                if (steps[k].load >= cap) {
+                    fits = false;
+                    break;
+                }
+            }
+        }
+        if (log != nullptr) log->push_back(TEvent{ cs, start, end, cap, fits });
+        return fits;
+    }
+
+    // Reserves a charger at station cs from start to end
+    void Reserve(int cs, float start, float end)
+    {
+        if (log != nullptr) log->push_back(TEvent{ cs, start, end, 0, -1 });
+        Add(cs, start, end, 1);
+    }
+
+    // Repeats the recorded queries and reservations. Returns false, with the reservations undone,
+    // as soon as a query gets another answer than the recorded one
+    bool Replay(const std::vector <TEvent>& events)
+    {
+        for (int e = 0; e < (int)events.size(); e++) {
+            const TEvent& event = events[e];
+            if (event.fits < 0) Add(event.cs, event.start, event.end, 1);
+            else if (Fits(event.cs, event.start, event.end, event.cap) != (event.fits == 1)) {
+                for (int u = 0; u < e; u++) {
+                    if (events[u].fits < 0) Add(events[u].cs, events[u].start, events[u].end, -1);
+                }
+                return false;
+            }
+        }
+        return true;
+    }
+
+private:
+    TStation& Station(int cs)
+    {
+        TStation& station = stations[cs];
+        if (station.epoch != epoch) {
+            station.epoch = epoch;
+            station.steps.assign(1, TStep{ 0, 0 });
+        }
+        return station;
+    }
+
+    // Adds delta to the load of station cs from start to end
+    void Add(int cs, float start, float end, int delta)
+    {
+        int a, b;
+        if (!Minutes(start, end, a, b)) return;
+        std::vector <TStep>& steps = Station(cs).steps;
+        int first = Split(steps, a);
+        int last = Split(steps, b);
+        for (int k = first; k < last; k++) {
+            steps[k].load += delta;
+        }
+    }
+
+    // Whole minutes [a, b) of the session inside the horizon, false if there are none
+    bool Minutes(float start, float end, int& a, int& b) const
+    {
+        a = std::max(0.0f, ceilf(start));
+        b = std::min((float)horizon, floorf(end));
+        return a < b;
+    }
+
+    // Index of the step holding time
+    static int Find(const std::vector <TStep>& steps, int time)
+    {
+        int lo = 0, hi = steps.size();          // steps[lo].time <= time < steps[hi].time
+        while (hi - lo > 1) {
+            int mid = (lo + hi) / 2;
+            if (steps[mid].time <= time) lo = mid;
+            else hi = mid;
+        }
+        return lo;
+    }
+
+    // Index of the step starting at time, splitting the step holding it if needed
+    static int Split(std::vector <TStep>& steps, int time)
+    {
+        int k = Find(steps, time);
+        if (steps[k].time == time) return k;
+        steps.insert(steps.begin() + k + 1, TStep{ time, steps[k].load });
+        return k + 1;
+    }
+};
+
+#endif
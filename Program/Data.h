@@ -5,6 +5,12 @@
 //using namespace std;
 #include <vector>
 #include <algorithm>    
+#include <new>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <math.h>
 
 
 //------ DEFINITION OF TYPES OF PROBLEM SPECIFIC --------
@@ -36,19 +42,201 @@ struct TCstat                               // struct with charging station spec
     int cap; // Number of chargers at this station
 };
 
+// Storage type of the travel-time matrix. Compile with -DFLOAT_MATRIX to store it in single precision (half the memory traffic)
+#ifdef FLOAT_MATRIX
+typedef float TDist;
+#else
+typedef double TDist;
+#endif
 
-//------ DEFINITION OF TYPES OF BRKGA-QL --------
+/***********************************************************************************
+ Struct: TAlignedAllocator
+ Description: allocator returning 64-byte (cache line) aligned memory
+************************************************************************************/
+template <class T>
+struct TAlignedAllocator
+{
+    typedef T value_type;
+    static const std::size_t alignment = 64;
+
+    TAlignedAllocator() {}
+    template <class U> TAlignedAllocator(const TAlignedAllocator<U>&) {}
+
+    T* allocate(std::size_t count) { return static_cast<T*>(::operator new(count * sizeof(T), std::align_val_t(alignment))); }
+    void deallocate(T* ptr, std::size_t) { ::operator delete(ptr, std::align_val_t(alignment)); }
+
+    template <class U> bool operator==(const TAlignedAllocator<U>&) const { return true; }
+    template <class U> bool operator!=(const TAlignedAllocator<U>&) const { return false; }
+};
+
+/***********************************************************************************
+ Struct: TMatrix
+ Description: dense row-major matrix stored in one contiguous, 64-byte aligned buffer.
+ Rows are padded to a whole number of cache lines, so m[i][j] is a single indexed load.
+ The buffer is either owned (resize) or a read-only view into a mapped instance cache (attach).
+************************************************************************************/
+struct TMatrix
+{
+    std::vector <TDist, TAlignedAllocator<TDist> > data;  // owned storage (empty when attached to a mapping)
+    std::shared_ptr <const void> mapping;       // keeps the mapped instance cache alive while attached
+    const TDist* base = nullptr;                // first element of row 0
+    int nbRows = 0;                             // number of rows (= number of columns)
+    int stride = 0;                             // number of elements between the starts of two rows
+
+    TMatrix() {}
+    TMatrix(const TMatrix& other) { *this = other; }
+
+    TMatrix& operator=(const TMatrix& other)
+    {
+        data = other.data;
+        mapping = other.mapping;
+        nbRows = other.nbRows;
+        stride = other.stride;
+        base = mapping ? other.base : data.data();
+        return *this;
+    }
+
+    static int paddedStride(int cols)
+    {
+        const int perLine = (int)(TAlignedAllocator<TDist>::alignment / sizeof(TDist));
+        return (cols + perLine - 1) / perLine * perLine;
+    }
+
+    void resize(int rows, int cols)
+    {
+        mapping.reset();
+        nbRows = rows;
+        stride = paddedStride(cols);
+        data.assign((std::size_t)rows * stride, 0);
+        base = data.data();
+    }
+
+    void attach(std::shared_ptr <const void> map, const TDist* first, int rows, int rowStride)
+    {
+        data.clear();
+        mapping = map;
+        base = first;
+        nbRows = rows;
+        stride = rowStride;
+    }
+
+    void clear() { data.clear(); mapping.reset(); base = nullptr; nbRows = 0; stride = 0; }
+
+    int size() const { return nbRows; }
+
+    TDist* operator[](int i) { return const_cast<TDist*>(base) + (std::size_t)i * stride; } // only writable when owned
+    const TDist* operator[](int i) const { return base + (std::size_t)i * stride; }
+};
+
+/***********************************************************************************
+ Struct: TArcSet
+ Description: square bit matrix over the nodes, one bit per arc (i,j), 64 arcs per word
+************************************************************************************/
+struct TArcSet
+{
+    std::vector <uint64_t> bits;                // row-major bits, each row padded to whole words
+    int words = 0;                              // number of words per row
+
+    void resize(int nbNodes)
+    {
+        words = (nbNodes + 63) / 64;
+        bits.assign((std::size_t)nbNodes * words, 0);
+    }
+
+    void set(int i, int j) { bits[(std::size_t)i * words + (j >> 6)] |= (uint64_t)1 << (j & 63); }
+
+    bool test(int i, int j) const { return (bits[(std::size_t)i * words + (j >> 6)] >> (j & 63)) & 1; }
+};
+
+/***********************************************************************************
+ Struct: TStationTable
+ Description: for every arc (i,j) the charging station indices ordered by detour
+ dist[i][s] + dist[s][j] (so also by detour energy), ended by noStation when shorter
+************************************************************************************/
+struct TStationTable
+{
+    static constexpr uint16_t noStation = 0xFFFF;
+    std::vector <uint16_t> order;               // nbNodes * nbNodes lists of nbStations entries
+    int nbNodes = 0;
+    int nbStations = 0;
+
+    const uint16_t* operator()(int i, int j) const { return order.data() + ((std::size_t)i * nbNodes + j) * nbStations; }
+};
+
+/***********************************************************************************
+ Struct: TPriceTable
+ Description: electricity prices per period with their running total, cost[p] being the
+ cost of charging from time 0 to the start of period p, so the cost of a session spanning
+ several periods needs no loop over them. Times from the end of the horizon on are priced
+ like the last period (charging stations can coincide with destination depots).
+************************************************************************************/
+struct TPriceTable
+{
+    std::vector <double> price;                 // price of each period (elecPrices)
+    std::vector <double> cost;                  // cost[p] = periodLength * (price[0] + ... + price[p-1])
+    int periodLength = 1;
+
+    // Period of time t
+    int Period(double t) const
+    {
+        int p = floor(t / periodLength);
+        return std::min(std::max(p, 0), (int)price.size() - 1);
+    }
+
+    // End of the last period
+    int Horizon() const { return price.size() * periodLength; }
+
+    // Price at time t
+    double Price(double t) const { return price[Period(t)]; }
+
+    // Cost of charging from start during length minutes
+    double Cost(double start, double length) const
+    {
+        int first = Period(start);
+        int last = Period(start + length);
+        if (first == last) return length * price[first];
+        return ((first + 1) * periodLength - start) * price[first] + (start + length - last * periodLength) * price[last] + (cost[last] - cost[first + 1]);
+    }
+};
 
 /***********************************************************************************
- Struct: TVecRk
- Description: struct to represent the random keys
+ Struct: TProblem
+ Description: instance data, filled once by ReadData() and afterwards only read
+ (passed by const reference to decoder, scheduler, local search and output)
 ************************************************************************************/
-struct TVecRk
+struct TProblem
 {
-    int user;                                // ID of the pick-up from the request
-    double rk;                               // random-key of chromosome
+    TMatrix dist;                               // matrix with Euclidean distance (travel times)
+    double dischRate;                           // battery consumption per unit of travel time (consumption i->j = dischRate * dist[i][j])
+    std::vector <TNode> node;                   // vector of CC-e-ADARP nodes (Pick-ups, Drop-offs, Origin depots, Final depots, Charging stations)
+    std::vector <TVhcl> vehicle;                // vector of vehicles
+    int nbVehicles;                             // #Vehicles
+    int nbUsers;                                // #Users
+    int periodLength;                           // Length in mins of one period with constant electricity price
+    int H;                                      // Planning horizon (mins)
+    std::vector <int> oDepotIDs;                // Origin depots IDs (only "artificial" ones)
+    std::vector <int> fDepotIDs;                // Final depots IDs (only "artificial" ones)
+    std::vector <TCstat> cStations;             // Charging stations
+    std::vector <int> maxRideTimes;             // Users maximum ride times
+    double weights[3];                          // Objective function weights
+    std::vector <double> elecPrices;            // Electricity prices
+    TArcSet forbiddenArcs;                      // arcs (i,j) that cannot appear in any feasible route (see EliminateArcs)
+    TArcSet lateArcs;                           // subset of forbiddenArcs excluded by the time windows alone
+    TStationTable closestStations;              // reachable charging stations per arc, closest first (see BuildStationTable)
+    TPriceTable prices;                         // electricity prices with their running total (see BuildPriceTable)
+    bool metric = false;                        // dist satisfies the triangle inequality (see CheckTriangleInequality)
 };
 
+
+//------ DEFINITION OF TYPES OF BRKGA-QL --------
+
+// Storage type of the random keys. Compile with -DFLOAT_KEYS to store them in single precision (half the chromosome memory)
+#ifdef FLOAT_KEYS
+typedef float TKey;
+#else
+typedef double TKey;
+#endif
+
 /***********************************************************************************
  Struct: TVecSol
  Description: struct to represent the solution
@@ -65,6 +253,155 @@ struct TVecSol
     bool c_station = false;               //indicates if a node is a charging station or not
 };
 
+/***********************************************************************************
+ Struct: TStopRef
+ Description: writable view on one stop of a TRoute, used like a TVecSol& (route[j].ET = ...)
+************************************************************************************/
+struct TStopRef
+{
+    int& stop;
+    double& T;
+    double& w;
+    double& ET;
+    double& LT;
+    int& C;
+    double& B;
+    char& c_station;
+
+    operator TVecSol() const
+    {
+        TVecSol v;
+        v.stop = stop; v.T = T; v.w = w; v.ET = ET; v.LT = LT; v.C = C; v.B = B; v.c_station = c_station;
+        return v;
+    }
+
+    TStopRef& operator=(const TVecSol& v)
+    {
+        stop = v.stop; T = v.T; w = v.w; ET = v.ET; LT = v.LT; C = v.C; B = v.B; c_station = v.c_station;
+        return *this;
+    }
+};
+
+/***********************************************************************************
+ Struct: TRoute
+ Description: route of one vehicle stored as structure of arrays: every field of the
+ stops has its own contiguous array, so the timing (stop, ET, LT), load (stop, C) and
+ battery (stop, B) loops only pull the cache lines they use. All arrays share one
+ allocation, so copying a route costs a single allocation like a std::vector <TVecSol>.
+ route[j] gives a TStopRef, or a TVecSol copy on a const route (used by Output.h).
+************************************************************************************/
+struct TRoute
+{
+    int* stop = nullptr;
+    double* T = nullptr;
+    double* w = nullptr;
+    double* ET = nullptr;
+    double* LT = nullptr;
+    int* C = nullptr;
+    double* B = nullptr;
+    char* c_station = nullptr;
+
+    TRoute() {}
+    TRoute(const TRoute& other) { *this = other; }
+    TRoute(TRoute&& other) noexcept { swap(other); }
+
+    TRoute& operator=(const TRoute& other)
+    {
+        if (this == &other) return *this;
+        block = other.block;                    // same layout as other: one copy of the whole block
+        count = other.count;
+        capacity = other.capacity;
+        layout();
+        return *this;
+    }
+
+    TRoute& operator=(TRoute&& other) noexcept { swap(other); return *this; }
+
+    std::size_t size() const { return count; }
+
+    TStopRef operator[](std::size_t i) { return TStopRef{ stop[i], T[i], w[i], ET[i], LT[i], C[i], B[i], c_station[i] }; }
+
+    TVecSol operator[](std::size_t i) const
+    {
+        TVecSol v;
+        v.stop = stop[i]; v.T = T[i]; v.w = w[i]; v.ET = ET[i]; v.LT = LT[i]; v.C = C[i]; v.B = B[i]; v.c_station = c_station[i];
+        return v;
+    }
+
+    void reserve(std::size_t newCapacity)
+    {
+        if (newCapacity <= capacity) return;
+        TRoute grown;
+        grown.block.resize(newCapacity * 5 + (newCapacity * (2 * sizeof(int) + sizeof(char)) + sizeof(double) - 1) / sizeof(double));
+        grown.capacity = newCapacity;
+        grown.layout();
+        grown.count = count;
+        grown.copyFields(*this, 0, 0, count);
+        swap(grown);
+    }
+
+    void insert(std::size_t i, const TVecSol& v)
+    {
+        if (count == capacity) reserve(std::max<std::size_t>(8, 2 * capacity));
+        copyFields(*this, i, i + 1, count - i); // overlapping, copyFields uses memmove
+        count++;
+        (*this)[i] = v;
+    }
+
+    void push_back(const TVecSol& v) { insert(count, v); }
+
+    void erase(std::size_t i)
+    {
+        copyFields(*this, i + 1, i, count - i - 1);
+        count--;
+    }
+
+    void pop_back() { count--; }
+
+    void clear() { count = 0; }
+
+    void swap(TRoute& other) noexcept
+    {
+        block.swap(other.block);
+        std::swap(count, other.count);
+        std::swap(capacity, other.capacity);
+        layout();
+        other.layout();
+    }
+
+private:
+    std::vector <double> block;                 // storage of all the field arrays, each of capacity elements
+    std::size_t count = 0;                      // number of stops
+    std::size_t capacity = 0;                   // number of stops the arrays can hold
+
+    void layout()
+    {
+        double* base = block.data();
+        T = base;
+        w = T + capacity;
+        ET = w + capacity;
+        LT = ET + capacity;
+        B = LT + capacity;
+        stop = reinterpret_cast<int*>(B + capacity);
+        C = stop + capacity;
+        c_station = reinterpret_cast<char*>(C + capacity);
+    }
+
+    // copies stops [from, from + n) of src to [to, to + n) of this route
+    void copyFields(const TRoute& src, std::size_t from, std::size_t to, std::size_t n)
+    {
+        if (n == 0) return;
+        std::memmove(stop + to, src.stop + from, n * sizeof(int));
+        std::memmove(T + to, src.T + from, n * sizeof(double));
+        std::memmove(w + to, src.w + from, n * sizeof(double));
+        std::memmove(ET + to, src.ET + from, n * sizeof(double));
+        std::memmove(LT + to, src.LT + from, n * sizeof(double));
+        std::memmove(C + to, src.C + from, n * sizeof(int));
+        std::memmove(B + to, src.B + from, n * sizeof(double));
+        std::memmove(c_station + to, src.c_station + from, n * sizeof(char));
+    }
+};
+
 
 /***********************************************************************************
  Struct: TSol
@@ -72,10 +409,11 @@ struct TVecSol
 ************************************************************************************/
 struct TSol
 {
-    std::vector <TVecRk> vec;               // id of user/pick-up and random key
-    std::vector <std::vector <TVecSol>> sol;// matrix to store solution routes + schedule
+    std::vector <TKey> vec;                 // random keys: 2*nbUsers request genes (gene i < nbUsers belongs to user i), nbVehicles vehicle genes, charging priority, scheduler, decoder
+    std::vector <TRoute> sol;               // solution routes + schedule, one per vehicle
     int battery_infeasibles = 0;            // Auxiliary element to indicate how many battery infeasibilities were incurred. So, obj fct can be adjusted to this number
     bool scheduled = false;                 // Auxiliary element for the schedulers
+    bool dominated = false;                 // decoding was stopped by the bound of Decoder(), fo is only a lower bound
     double fo;                              // objetive function value
     int label;                              // defines a community solution with a number
     int similar;                            // indicates if a solution is similar to other (0 no, 1 yes)
@@ -86,6 +424,111 @@ struct TSol
     double CC;
 };
 
+/***********************************************************************************
+ Struct: TDecodeTrace
+ Description: how the insertion decoder built the routes of an individual: the users of
+ each vehicle in insertion order and snapshots of the route after its first 1, 2, 3, 4,
+ 6, 9, 13, ... users. A route only depends on its final depot and on the sequence of its
+ users, so an offspring whose vehicle starts with the same users as in its elite parent
+ resumes from the parent's snapshot (see InsertionDecoder). decoder is 0 if there is no trace.
+************************************************************************************/
+struct TDecodeTrace
+{
+    int decoder = 0;                            // decoder variant that built the routes
+    std::vector <int> fDepot;                   // final depot of each vehicle
+    std::vector <int> userStart;                // users of vehicle v: users[userStart[v]..userStart[v+1])
+    std::vector <int> users;
+    std::vector <int> snapStart;                // snapshots of vehicle v: snapshot[snapStart[v]..snapStart[v+1])
+    std::vector <int> snapUsers;                // number of users of the vehicle in each snapshot
+    std::vector <TRoute> snapshot;              // only the first snapUsers.size() are in use (the others keep their storage)
+
+    // Appends a snapshot of route after its first count users (snapStart is closed by the caller after each vehicle)
+    void TakeSnapshot(const TRoute& route, int count)
+    {
+        int q = snapUsers.size();
+        if ((int)snapshot.size() <= q) snapshot.resize(std::max(8, 2 * q));
+        snapshot[q] = route;
+        snapUsers.push_back(count);
+    }
+};
+
+/***********************************************************************************
+ Struct: TPopulation
+ Description: population of the BRKGA stored as genotypes only: the random keys of
+ all individuals in one contiguous row-major matrix (row i = the nbGenes keys of
+ individual i) next to per-individual arrays of fitness and LS bookkeeping. Routes
+ are not kept; an individual is decoded again from its keys when it is needed. The
+ trace of the decoding is kept for the initial (or restarted) population and for the
+ offspring that enter the elite set, as only elite parents are resumed from.
+************************************************************************************/
+struct TPopulation
+{
+    std::vector <TKey> keys;                // size() x nbGenes random keys
+    std::vector <double> fo;                // objetive function value of each individual
+    std::vector <int> label;                // community of each individual (LP)
+    std::vector <int> flag;                 // local search already performed (0 no, 1 yes)
+    std::vector <int> promising;            // promising to apply local search (0 no, 1 yes)
+    std::vector <TDecodeTrace> trace;       // decode trace of each individual (decoder 0 if not kept)
+    int nbGenes = 0;                        // number of random keys of an individual
+
+    int size() const { return (int)fo.size(); }
+
+    // resize to count individuals, keeping the first ones
+    void resize(int count, int genes)
+    {
+        nbGenes = genes;
+        keys.resize((std::size_t)count * genes);
+        fo.resize(count);
+        label.resize(count);
+        flag.resize(count);
+        promising.resize(count);
+        trace.resize(count);
+    }
+
+    void clear() { resize(0, nbGenes); }
+
+    TKey* operator[](int i) { return keys.data() + (std::size_t)i * nbGenes; }
+    const TKey* operator[](int i) const { return keys.data() + (std::size_t)i * nbGenes; }
+
+    // copies individual from of src to position to
+    void copy(int to, const TPopulation& src, int from)
+    {
+        std::memcpy((*this)[to], src[from], nbGenes * sizeof(TKey));
+        fo[to] = src.fo[from];
+        label[to] = src.label[from];
+        flag[to] = src.flag[from];
+        promising[to] = src.promising[from];
+    }
+
+    // copies individual from of src to position to and hands its decode trace over (src keeps none)
+    void move(int to, TPopulation& src, int from)
+    {
+        copy(to, src, from);
+        std::swap(trace[to], src.trace[from]);
+        src.trace[from].decoder = 0;
+    }
+
+    // exchanges the storage of two populations (no copy)
+    void swap(TPopulation& other)
+    {
+        keys.swap(other.keys);
+        fo.swap(other.fo);
+        label.swap(other.label);
+        flag.swap(other.flag);
+        promising.swap(other.promising);
+        trace.swap(other.trace);
+        std::swap(nbGenes, other.nbGenes);
+    }
+
+    // stores the keys and fitness of a decoded solution at position i
+    void store(int i, const TSol& s)
+    {
+        std::memcpy((*this)[i], s.vec.data(), nbGenes * sizeof(TKey));
+        fo[i] = s.fo;
+        flag[i] = s.flag;
+    }
+};
+
 
 /***********************************************************************************
  Struct: TQ
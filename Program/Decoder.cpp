@@ -1,22 +1,23 @@
 #include "Decoder.h"
 
-// Sort TSol by random-keys
-bool sortByRk(const TVecRk& lhs, const TVecRk& rhs) { return lhs.rk < rhs.rk; }
-
-// Sort TSol by user
-bool sortByUser(const TVecRk& lhs, const TVecRk& rhs) { return lhs.user < rhs.user; }
-
-TSol Decoder(TSol s, int n, std::vector <TNode> node,
-    std::vector <std::vector <double> > dist, std::vector <TVhcl> vehicle,
-    int nbVehicles, int nbUsers, int periodLength, int H, std::vector <int> oDepotIDs, std::vector <int> fDepotIDs,
-    std::vector <TCstat> cStations, std::vector <int> maxRideTimes, double weights[3], std::vector <double> elecPrices, std::vector <std::vector <double> > cons)
+// Insertion decoders, selected by the decoder gene (last key)
+static const TDecoderFct decoders[] = {
+    InsertionDecoder<true>,                     // 1 - ascending insert-all pick-up first
+    InsertionDecoder<false>                     // 2 - ascending insert-all drop-off first
+};
+static const int numDecoders = sizeof(decoders) / sizeof(decoders[0]);
+
+TSol Decoder(TSol s, int n, const TProblem& problem, double bound, const TDecodeTrace* parent, TDecodeTrace* trace, bool portfolio)
 {
-
-    int numDecoders = 2;
+    const std::vector <TNode>& node = problem.node;
+    const std::vector <TVhcl>& vehicle = problem.vehicle;
+    const std::vector <int>& oDepotIDs = problem.oDepotIDs;
+    int nbVehicles = problem.nbVehicles;
 
     // Create initial solution (for each vehicle a route between the origin depot and the assigned final depot
-    TVecSol tempVecSol;
-    std::vector <int> fDepAss = AssignFinalDepots(s.vec, nbUsers, nbVehicles, fDepotIDs, dist);
+    TVecSol tempVecSol{};
+    static thread_local std::vector <int> fDepAss;
+    AssignFinalDepots(s.vec, problem, fDepAss);
     for (int i = 0; i < nbVehicles; i++) {
         // Assign origin depot & set correct starting capacities
         tempVecSol.stop = oDepotIDs[i]-1; // Correct origin depot, -1 because indexes start at 0
@@ -35,308 +36,248 @@ TSol Decoder(TSol s, int n, std::vector <TNode> node,
         s.sol[i].push_back(tempVecSol);
     }
 
-    int dec = ceil(s.vec[n].rk*numDecoders + 0.000000000001);
-    //printf("\n%d (%.2lf)", dec, s.vec[n].rk);
+    int dec = ceil(s.vec[n]*numDecoders + 0.000000000001);
+    //printf("\n%d (%.2lf)", dec, s.vec[n]);
 
     s.fo = -1; // Set objective value to -1 for testing feasibility later
+    s.dominated = false;
 
-    switch (dec)
-    {
-        case 1: // Ascending insert-all pick-up first
-            s = Dec1(s, n, node, dist, vehicle, nbVehicles, nbUsers, periodLength, H, oDepotIDs, fDepotIDs, cStations, maxRideTimes, weights, elecPrices, cons);
-            break;
+    // The routes of the parent can only be reused if they were built by the same decoder
+    if (parent != nullptr && parent->decoder != dec) parent = nullptr;
+    if (trace != nullptr) trace->decoder = dec;
 
-        case 2: // Ascending insert-all drop-off first
-            s = Dec2(s, n, node, dist, vehicle, nbVehicles, nbUsers, periodLength, H, oDepotIDs, fDepotIDs, cStations, maxRideTimes, weights, elecPrices, cons);
-            break;
-
-        default:
-            int i = 0;
-            break;
+    if (dec >= 1 && dec <= numDecoders) {
+        s = decoders[dec - 1](std::move(s), n, problem, bound, parent, trace);
     }
 
-    // Sort vec back by user, else vec is not correctly used by the scheduler and the parametric crossover
-    sort(s.vec.begin(), s.vec.begin() + nbUsers, sortByUser);
-
     // if objective value is still -1, it means it has NOT been set to a high value by the decoder to indicate infeasibility
     // So, in this case, scheduling should be applied and objective value should be calculated in the normal way
     if (s.fo == -1) {
-        s = Scheduler(s, node, dist, vehicle, nbUsers, nbVehicles, periodLength, cStations, maxRideTimes, weights, elecPrices, cons);
+        s = portfolio ? PortfolioScheduler(std::move(s), problem) : Scheduler(std::move(s), problem, nullptr);
         if (s.scheduled) {
-            s.fo = objFct(s, node, dist, nbVehicles, nbUsers, periodLength, maxRideTimes, weights, elecPrices);
+            s.fo = objFct(s, problem);
         }
     }
     
     return s;
 }
 
-TSol Dec1(TSol s, int n, std::vector <TNode> node,
-    std::vector <std::vector <double> > dist, std::vector <TVhcl> vehicle,
-    int nbVehicles, int nbUsers, int periodLength, int H, std::vector <int> oDepotIDs, std::vector <int> fDepotIDs,
-    std::vector <TCstat> cStations, std::vector <int> maxRideTimes, double weights[3], std::vector <double> elecPrices, std::vector <std::vector <double> > cons)
+template <bool pickUpFirst>
+TSol InsertionDecoder(TSol s, int n, const TProblem& problem, double bound, const TDecodeTrace* parent, TDecodeTrace* trace)
 {
-    // sort random-key vector (of the rk's relating to pickups)
-    sort(s.vec.begin(), s.vec.begin() + nbUsers, sortByRk);
+    int nbVehicles = problem.nbVehicles;
+    int nbUsers = problem.nbUsers;
+
+    // order the users by the random key of their pick-up
+    static thread_local std::vector <int> order;
+    ArgSortKeys(s.vec.data(), nbUsers, order);
+
+    // A user only changes the route of its own vehicle, so the routes are built one after the other:
+    // bucket the positions in order by vehicle (counting sort, so they stay ascending within a vehicle)
+    static thread_local std::vector <int> vehOf;
+    static thread_local std::vector <int> bucketStart;
+    static thread_local std::vector <int> bucket;
+    vehOf.resize(nbUsers);
+    bucketStart.assign(nbVehicles + 1, 0);
+    bucket.resize(nbUsers);
+    for (int i = 0; i < nbUsers; i++) {
+        vehOf[i] = floor(s.vec[order[i]] * nbVehicles); // Determine which vehicle to insert into
+        bucketStart[vehOf[i] + 1]++;
+    }
+    for (int v = 0; v < nbVehicles; v++) {
+        bucketStart[v + 1] += bucketStart[v];
+    }
+    for (int i = 0; i < nbUsers; i++) {
+        bucket[bucketStart[vehOf[i]]++] = i;
+    }
+    for (int v = nbVehicles; v > 0; v--) {
+        bucketStart[v] = bucketStart[v - 1];
+    }
+    bucketStart[0] = 0;
+
+    // Load and time-window state of the route being built, to test insertions without copying the route
+    static thread_local TRouteTiming timing;
+    static thread_local std::vector <TRoute> emptyRoute;    // route of each vehicle before decoding
+    static thread_local std::vector <int> lastInserted;     // position in order of the last user inserted in each vehicle
+    emptyRoute.resize(nbVehicles);
+    lastInserted.resize(nbVehicles);
+    int failed = nbUsers;                                   // position in order of the first user that cannot be inserted
+
+    // Lower bound on the objective value of each route, to stop decoding once the total exceeds bound
+    static thread_local std::vector <double> routeBound;
+    double totalBound = 0;
+    if (bound < INFINITY) {
+        routeBound.resize(nbVehicles);
+        for (int v = 0; v < nbVehicles; v++) {
+            routeBound[v] = RouteBound(s.sol[v], problem);
+            totalBound += routeBound[v];
+        }
+    }
 
-    // In ascending order, go over users and assign them to vehicles, immediately applying cheapest feasible insertion
-    int veh = 0;
-    int bestInsert = 0;
-    int j = 0;
-    float costBest = INFINITO;
-    float costInsertion = 0;
-    TVecSol precStop;
-    TVecSol tempStop{};
-    std::vector <TVecSol> tempRoute;
-    std::vector <TVecSol> bestRoute;
-    std::vector <TVecSol> backUp;
-    bool feasible = true;
+    if (trace != nullptr) {
+        trace->fDepot.resize(nbVehicles);
+        trace->userStart.assign(1, 0);
+        trace->users.clear();
+        trace->snapStart.assign(1, 0);
+        trace->snapUsers.clear();
+    }
 
-    for (int i = 0; i < nbUsers; i++) {
-        veh = floor(s.vec[i].rk * nbVehicles); // Determine which vehicle to insert into
-        bestRoute = s.sol[veh];
-        backUp = s.sol[veh];
-
-        for (int nodeID : {s.vec[i].user, nbUsers + s.vec[i].user}) { // Once for pick-up node, once for drop-off node
-            costBest = INFINITO;
-            // Determine cheapest feasible insertion
-            // If drop-off node, start searching where you just inserted the pick-up. Else (if pick-up), start search at first position.
-            if (nodeID >= nbUsers) {
-                j = bestInsert + 1; // set starting search position to position after where you just inserted the related pickup
+    // For each vehicle, go over its users in ascending order, immediately applying cheapest feasible insertion
+    for (int v = 0; v < nbVehicles; v++) {
+        emptyRoute[v] = s.sol[v];
+        lastInserted[v] = -1;
+        int finalDepot = s.sol[v].stop[s.sol[v].size() - 1];
+        int k = bucketStart[v];
+        int nextSnap = 1; // number of users of the next snapshot
+
+        // Resume from the latest snapshot of the parent whose users are the first users of this vehicle
+        if (parent != nullptr && parent->fDepot[v] == finalDepot) {
+            const int* parentUsers = parent->users.data() + parent->userStart[v];
+            int nbParentUsers = parent->userStart[v + 1] - parent->userStart[v];
+            int common = 0;
+            while (k + common < bucketStart[v + 1] && common < nbParentUsers && bucket[k + common] < failed && order[bucket[k + common]] == parentUsers[common]) {
+                common++;
             }
-            else { j = 1; }
-            while (j < s.sol[veh].size()) { // For all possible insertion positions
-                feasible = true;
-                if (node[nodeID].arr < node[s.sol[veh][j].stop].dep - dist[nodeID][s.sol[veh][j].stop] - node[nodeID].d) { // If soonest time of node you want to insert is earlier than latest time of node that would be visited next if inserted (- travel time & service time). In the other case, insertion will be infeasible anyway.
-                    precStop = s.sol[veh][j - 1];
-                    // Check if cheapest
-                    costInsertion = dist[precStop.stop][nodeID] + dist[nodeID][s.sol[veh][j].stop] - dist[precStop.stop][s.sol[veh][j].stop];
-                    // Only check feasibility if cheapest.
-                    if (costInsertion < costBest) {
-                        // Create a temporary route                  
-                        tempRoute = s.sol[veh];
-                        tempStop.stop = nodeID;
-                        tempRoute.insert(tempRoute.begin() + j, tempStop); // Insert the stop into the temporary route   
-                        // Update capacity and check feasibility
-                        for (int k = j; k < tempRoute.size(); k++) {
-                            tempRoute[k].C = tempRoute[k - 1].C - node[tempRoute[k].stop].l;
-                            if (tempRoute[k].C < 0) {
-                                feasible = false;
-                                break;
-                            }
-                        }
-                        // If not load-feasible, go to next insertion
-                        if (!feasible) {
-                            j++;
-                            continue;
-                        }
-                        // Update earliest start-time
-                        tempRoute[j].ET = std::max(tempRoute[j - 1].ET + node[tempRoute[j - 1].stop].d + dist[tempRoute[j - 1].stop][tempRoute[j].stop], node[tempRoute[j].stop].arr);
-                        // Update latest start-time
-                        tempRoute[j].LT = std::min(tempRoute[j + 1].LT - node[tempRoute[j].stop].d - dist[tempRoute[j].stop][tempRoute[j + 1].stop], node[tempRoute[j].stop].dep);
-                        // If tightened window indicates infeasible, set to infeasibility
-                        if (tempRoute[j].LT < tempRoute[j].ET) {
-                            feasible = false;
-                        }
-                        else {
-                            // If tightened window does not indicate infeasibility, update ET and LT of other stops and check feasibility again
-                            // Update LT "backwards" as long as needed
-                            for (int k = j - 1; k >= 0; k--) {
-                                if (tempRoute[k + 1].LT - dist[tempRoute[k].stop][tempRoute[k + 1].stop] - node[tempRoute[k].stop].d < tempRoute[k].LT) { // If LT needs to be updated
-                                    tempRoute[k].LT = tempRoute[k + 1].LT - dist[tempRoute[k].stop][tempRoute[k + 1].stop] - node[tempRoute[k].stop].d; // Update LT
-                                    // Check new tightened window
-                                    if (tempRoute[k].LT < tempRoute[k].ET) {
-                                        feasible = false;
-                                        break;
-                                    }
-                                }
-                                else break; // Else, you can stop backwards updating
-                            }
-                            // IF STILL FEASIBLE, update ET "forwards" as long as needed
-                            if (feasible) {
-                                for (int k = j + 1; k < tempRoute.size(); k++) {
-                                    if (tempRoute[k - 1].ET + dist[tempRoute[k - 1].stop][tempRoute[k].stop] + node[tempRoute[k - 1].stop].d > tempRoute[k].ET) { // If ET needs to be updated
-                                        tempRoute[k].ET = tempRoute[k - 1].ET + dist[tempRoute[k - 1].stop][tempRoute[k].stop] + node[tempRoute[k - 1].stop].d; // Update ET
-                                        // Check new tightened window
-                                        if (tempRoute[k].LT < tempRoute[k].ET) {
-                                            feasible = false;
-                                            break;
-                                        }
-                                    }
-                                    else break; // Else, you can stop forwards updating
-                                }
-                            }
-                        }
-                        // If temporary route is feasible, copy to best route and set best cost to the cost of this insertion                   
-                        if (feasible) {
-                            bestRoute = tempRoute;
-                            costBest = costInsertion;
-                            bestInsert = j;
-                        }
-                    }
+            int resumed = 0;
+            for (int q = parent->snapStart[v]; q < parent->snapStart[v + 1] && parent->snapUsers[q] <= common; q++) {
+                resumed = q - parent->snapStart[v] + 1;
+            }
+            if (resumed > 0) {
+                int q = parent->snapStart[v] + resumed - 1;
+                s.sol[v] = parent->snapshot[q];
+                if (trace != nullptr) { // The snapshots up to there hold for this vehicle too
+                    for (int r = parent->snapStart[v]; r <= q; r++) trace->TakeSnapshot(parent->snapshot[r], parent->snapUsers[r]);
+                }
+                nextSnap = parent->snapUsers[q] + std::max(1, parent->snapUsers[q] / 2);
+                k += parent->snapUsers[q];
+                lastInserted[v] = bucket[k - 1];
+                if (bound < INFINITY) {
+                    double newBound = RouteBound(s.sol[v], problem);
+                    totalBound += newBound - routeBound[v];
+                    routeBound[v] = newBound;
                 }
-                j++;
             }
-            // Check feasibility of this assignment of requests to vehicles
-            if (s.sol[veh].size() == bestRoute.size()) {
-                // If best route found is as long as current route, no feasible insertion was found.
-                // So, objective value is set to high value and we stop decoding further.
-                // Because we want to reward attempts that "almost" were feasible, the high value depends on this
-                s.fo = (nbUsers - i) * 1000000;
-                s.sol[veh] = backUp; // Over-write inserted pick-up if dropoff isn't feasibly insertable.
-                return s;
-
-                /*ALTERNATIVE
-                if (s.fo == -1) s.fo += 1;
-                s.fo += 1000000; // Add 1 million because 1 infeasible insertion found
-                bestInsert = 0; // Set to 0 so dropoff can be inserted even if pickup cant
-                continue; // Move-on to next node (so, even tho pickup couldn't be inserted, still try to insert drop-off. This way, if both pick-up and drop-off are uninsertable, a larger penalty is set)*/
+        }
+        if (trace != nullptr) {
+            trace->fDepot[v] = finalDepot;
+            for (int r = bucketStart[v]; r < k; r++) trace->users.push_back(order[bucket[r]]);
+        }
+
+        timing.Build(s.sol[v], problem);
+        for (; k < bucketStart[v + 1] && bucket[k] < failed; k++) {
+            if (!InsertRequest<pickUpFirst>(s.sol[v], timing, order[bucket[k]], problem)) {
+                failed = bucket[k]; // Decoding in order stops at the first user that cannot be inserted, whatever its vehicle
+                break;
+            }
+            lastInserted[v] = bucket[k];
+            if (trace != nullptr) {
+                trace->users.push_back(order[bucket[k]]);
+                int inserted = k + 1 - bucketStart[v];
+                if (inserted == nextSnap) {
+                    trace->TakeSnapshot(s.sol[v], inserted);
+                    nextSnap = inserted + std::max(1, inserted / 2);
+                }
+            }
+
+            // Stop if the objective value cannot get below bound anymore (a battery infeasible solution costs at least 100000)
+            if (bound < INFINITY) {
+                double newBound = RouteBound(s.sol[v], problem);
+                totalBound += newBound - routeBound[v];
+                routeBound[v] = newBound;
+                if (std::min(totalBound, 100000.0) > bound) {
+                    s.fo = std::min(totalBound, 100000.0);
+                    s.dominated = true;
+                    if (trace != nullptr) trace->decoder = 0; // The trace of the remaining vehicles is missing
+                    return s;
+                }
+            }
+        }
+        if (trace != nullptr) {
+            trace->userStart.push_back(trace->users.size());
+            trace->snapStart.push_back(trace->snapUsers.size());
+        }
+    }
+
+    if (failed < nbUsers) {
+        // If no feasible insertion was found, objective value is set to high value.
+        // Because we want to reward attempts that "almost" were feasible, the high value depends on this
+        s.fo = (nbUsers - failed) * 1000000;
+
+        // Keep only the users before the failed one, as decoding in order would have: rebuild the routes that got further
+        for (int v = 0; v < nbVehicles; v++) {
+            if (lastInserted[v] < failed) continue;
+            s.sol[v] = emptyRoute[v];
+            timing.Build(s.sol[v], problem);
+            for (int k = bucketStart[v]; k < bucketStart[v + 1] && bucket[k] < failed; k++) {
+                InsertRequest<pickUpFirst>(s.sol[v], timing, order[bucket[k]], problem);
             }
-            // If  feasible inserted, copy best route to solution
-            s.sol[veh] = bestRoute;
         }
     }
 
     return s;
 }
 
-TSol Dec2(TSol s, int n, std::vector <TNode> node,
-    std::vector <std::vector <double> > dist, std::vector <TVhcl> vehicle,
-    int nbVehicles, int nbUsers, int periodLength, int H, std::vector <int> oDepotIDs, std::vector <int> fDepotIDs,
-    std::vector <TCstat> cStations, std::vector <int> maxRideTimes, double weights[3], std::vector <double> elecPrices, std::vector <std::vector <double> > cons)
+template <bool pickUpFirst>
+bool InsertRequest(TRoute& route, TRouteTiming& timing, int user, const TProblem& problem)
 {
-    // sort random-key vector (of the rk's relating to pickups)
-    sort(s.vec.begin(), s.vec.begin() + nbUsers, sortByRk);
+    const TArcSet& forbiddenArcs = problem.forbiddenArcs;
+    const TArcSet& lateArcs = problem.lateArcs;
+    int nbUsers = problem.nbUsers;
 
-    // In ascending order, go over users and assign them to vehicles, immediately applying cheapest feasible insertion
-    int veh = 0;
     int bestInsert = 0;
+    int begin = 0;
     int end = 0;
     float costBest = INFINITO;
     float costInsertion = 0;
-    TVecSol precStop;
-    TVecSol tempStop{};
-    std::vector <TVecSol> tempRoute;
-    std::vector <TVecSol> bestRoute;
-    std::vector <TVecSol> backUp;
-    bool feasible = true;
-
-    for (int i = 0; i < nbUsers; i++) {
-        veh = floor(s.vec[i].rk * nbVehicles); // Determine which vehicle to insert into
-        bestRoute = s.sol[veh];
-        backUp = s.sol[veh];
-
-        for (int nodeID : {nbUsers + s.vec[i].user, s.vec[i].user}) { // Once for drop-off node, once for pick-up node
-            costBest = INFINITO;
-            // Determine cheapest feasible insertion
-            // If pick-up node, end searching where you just inserted the drop-off. Else (if drop-off), end search at last position.
-            if (nodeID < nbUsers) {
-                end = bestInsert + 1; // set ending search position to position where you just inserted the related drop-off (+1 for range purposes)
-            }
-            else { end  = s.sol[veh].size(); }
-            for (int j = 1; j < end; j++) { // For all possible insertion positions
-                feasible = true;
-                if (node[nodeID].arr < node[s.sol[veh][j].stop].dep - dist[nodeID][s.sol[veh][j].stop] - node[nodeID].d) { // If soonest time of node you want to insert is earlier than latest time of node that would be visited next if inserted (- travel time & service time). In the other case, insertion will be infeasible anyway.
-                    precStop = s.sol[veh][j - 1];
-                    // Check if cheapest
-                    costInsertion = dist[precStop.stop][nodeID] + dist[nodeID][s.sol[veh][j].stop] - dist[precStop.stop][s.sol[veh][j].stop];
-                    // Only check feasibility if cheapest.
-                    if (costInsertion < costBest) {
-                        // Check load capacity feasibility
-                        tempStop.C = precStop.C - node[nodeID].l;
-                        if (tempStop.C < 0) {
-                            j++; continue;
-                        } // If load capacity violated, skip this insertion and check next
-                        // Create a temporary route                  
-                        tempRoute = s.sol[veh];
-                        tempStop.stop = nodeID;
-                        tempRoute.insert(tempRoute.begin() + j, tempStop); // Insert the stop into the temporary route 
-                        // Update capacity and check feasibility
-                        for (int k = j; k < tempRoute.size(); k++) {
-                            tempRoute[k].C = tempRoute[k - 1].C - node[tempRoute[k].stop].l;
-                            if (tempRoute[k].C < 0) {
-                                feasible = false;
-                                break;
-                            }
-                        }
-                        // If not load-feasible, go to next insertion
-                        if (!feasible) {
-                            continue;
-                        }
-                        // Update earliest start-time
-                        tempRoute[j].ET = std::max(tempRoute[j - 1].ET + node[tempRoute[j - 1].stop].d + dist[tempRoute[j - 1].stop][tempRoute[j].stop], node[tempRoute[j].stop].arr);
-                        // Update latest start-time
-                        tempRoute[j].LT = std::min(tempRoute[j + 1].LT - node[tempRoute[j].stop].d - dist[tempRoute[j].stop][tempRoute[j + 1].stop], node[tempRoute[j].stop].dep);
-                        // If tightened window indicates infeasible, set to infeasibility
-                        if (tempRoute[j].LT < tempRoute[j].ET) {
-                            feasible = false;
-                        }
-                        else {
-                            // If tightened window does not indicate infeasibility, update ET and LT of other stops and check feasibility again
-                            // Update LT "backwards" as long as needed
-                            for (int k = j - 1; k >= 0; k--) {
-                                if (tempRoute[k + 1].LT - dist[tempRoute[k].stop][tempRoute[k + 1].stop] - node[tempRoute[k].stop].d < tempRoute[k].LT) { // If LT needs to be updated
-                                    tempRoute[k].LT = tempRoute[k + 1].LT - dist[tempRoute[k].stop][tempRoute[k + 1].stop] - node[tempRoute[k].stop].d; // Update LT
-                                    // Check new tightened window
-                                    if (tempRoute[k].LT < tempRoute[k].ET) {
-                                        feasible = false;
-                                        break;
-                                    }
-                                }
-                                else break; // Else, you can stop backwards updating
-                            }
-                            // IF STILL FEASIBLE, update ET "forwards" as long as needed
-                            if (feasible) {
-                                for (int k = j + 1; k < tempRoute.size(); k++) {
-                                    if (tempRoute[k - 1].ET + dist[tempRoute[k - 1].stop][tempRoute[k].stop] + node[tempRoute[k - 1].stop].d > tempRoute[k].ET) { // If ET needs to be updated
-                                        tempRoute[k].ET = tempRoute[k - 1].ET + dist[tempRoute[k - 1].stop][tempRoute[k].stop] + node[tempRoute[k - 1].stop].d; // Update ET
-                                        // Check new tightened window
-                                        if (tempRoute[k].LT < tempRoute[k].ET) {
-                                            feasible = false;
-                                            break;
-                                        }
-                                    }
-                                    else break; // Else, you can stop forwards updating
-                                }
-                            }
-                        }
-                        // If temporary route is feasible, update load capacities and copy to best route and set best cost to the cost of this insertion  
-                        // Update load capacities from insertion onwards
-                        for (int k = j + 1; k < tempRoute.size(); k++) {
-                            tempRoute[k].C = tempRoute[k - 1].C - node[tempRoute[k].stop].l;
-                        }
-                        if (feasible) {
-                            bestRoute = tempRoute;
-                            costBest = costInsertion;
-                            bestInsert = j;
-                        }
-                    }
-                }
-            }
-            // Check feasibility of this assignment of requests to vehicles
-            if (s.sol[veh].size() == bestRoute.size()) {
-                // If best route found is as long as current route, no feasible insertion was found.
-                // So, objective value is set to high value and we stop decoding further.
-                // Because we want to reward attempts that "almost" were feasible, the high value depends on this
-                s.fo = (nbUsers - i) * 1000000;
-                s.sol[veh] = backUp; // Over-write inserted dropoff if pickup can't be inserted.
-                return s;
-
-                /*ALTERNATIVE
-                if (s.fo == -1) s.fo += 1;
-                s.fo += 1000000; // Add 1 million because 1 infeasible insertion found
-                bestInsert = 0; // Set to 0 so pickup can be inserted even if drop-off cant
-                continue; // Move-on to next node (so, even tho drop-off couldn't be inserted, still try to insert pick-up. This way, if both pick-up and drop-off are uninsertable, a larger penalty is set)*/
+    static thread_local TInsertionCosts costs;
+    static thread_local TRoute backUp;
+    backUp = route;
+    bool inserted = false;
+
+    for (int second = 0; second < 2; second++) { // Once for the node inserted first, once for its pair
+        int nodeID = (pickUpFirst == (second == 0)) ? user : nbUsers + user;
+        costBest = INFINITO;
+        inserted = false;
+        // Determine cheapest feasible insertion
+        // The pair is inserted after the pick-up (pick-up first) or before the drop-off (drop-off first)
+        // at the position of the node inserted first. The node inserted first can go anywhere.
+        begin = 1;
+        end = route.size();
+        if (second) {
+            if (pickUpFirst) begin = bestInsert + 1;
+            else end = bestInsert + 1;
+        }
+        // While the pick-up is not in the route yet only the time-window eliminations hold for the drop-off
+        const TArcSet& arcs = (!pickUpFirst && !second) ? lateArcs : forbiddenArcs;
+        costs.Compute(route, nodeID, begin, end, arcs, false, problem);
+        for (int j = begin; j < end; j++) { // For all possible insertion positions
+            // Only check feasibility if cheapest (an insertion ruled out by an eliminated arc or by the time windows costs INFINITY). If load and time windows allow it, remember this insertion
+            costInsertion = costs[j];
+            if (costInsertion < costBest && timing.LoadFeasible(route, j, nodeID, problem) && timing.TimeFeasible(route, j, nodeID, problem)) {
+                costBest = costInsertion;
+                bestInsert = j;
+                inserted = true;
             }
-
-            // If feasible inserted, copy best route to solution
-            s.sol[veh] = bestRoute;
         }
+        if (!inserted) {
+            route = backUp; // Over-write the node inserted first if its pair isn't feasibly insertable.
+            timing.Build(route, problem);
+            return false;
+        }
+        // If feasibly inserted, apply the best insertion to the route
+        timing.Insert(route, bestInsert, nodeID, problem);
     }
-
-    return s;
+    return true;
 }
 
-double objFct(TSol s, std::vector <TNode>& node, std::vector <std::vector <double> > &dist, int nbVehicles, int nbUsers, int periodLength, std::vector <int> maxRideTimes, double weights[3], std::vector <double> elecPrices) {
+double objFct(const TSol& s, const TProblem& problem) {
+    const std::vector <TNode>& node = problem.node;
+    const TMatrix& dist = problem.dist;
+    const std::vector <int>& maxRideTimes = problem.maxRideTimes;
+    const TPriceTable& prices = problem.prices;
+    const double* weights = problem.weights;
+    int nbVehicles = problem.nbVehicles;
+    int nbUsers = problem.nbUsers;
 
     // If battery infeasible, no point in calculating objective function
     if (s.battery_infeasibles > 0) {
@@ -347,12 +288,11 @@ double objFct(TSol s, std::vector <TNode>& node, std::vector <std::vector <doubl
     double ERT = 0; // Excess Ride Time
     double CC = 0;  // Charging cost
     double penalty = 0; // Penalty for URT violation
-    std::vector <double> URTs; // User Ride Times
+    static thread_local std::vector <double> URTs; // User Ride Times
     int currStop = -1;
     int nextStop = -1;
-    int startPeriod;
-    int endPeriod;
 
+    URTs.clear();
     for (int u = 0; u < nbUsers; u++) { // Initialize User Ride Times by substracting service time already
         URTs.push_back(-1 * node[u].d);
     }
@@ -374,25 +314,8 @@ double objFct(TSol s, std::vector <TNode>& node, std::vector <std::vector <doubl
                 URTs[currStop-nbUsers] += s.sol[v][i].T; // Add start-time of service at pick-up
             }
             else { // Else, current stop is a charging station
-                // Find period in which charging starts and ends
-                startPeriod = floor(s.sol[v][i].T / periodLength);
-                endPeriod = floor((s.sol[v][i].T + s.sol[v][i].w) / periodLength);
-                if (endPeriod == elecPrices.size()) { endPeriod = endPeriod - 1; }  // This is to prevent subscript errors when charging ends exactly at the time horizon -> floor function above acts as if charging ends after H, while it ends just at H (possible because charging stations can coincide with destination depots)
-                if (startPeriod == elecPrices.size()) { startPeriod = startPeriod - 1; } // Similar but for case where 'charging' starts at H (nonsensical case but possible because charging stations can coincide
-                // If whole session in 1 period
-                if (startPeriod == endPeriod) {
-                    CC += s.sol[v][i].w * elecPrices[startPeriod];
-                }
-                else {
-                    // Calculate cost during first and last period
-                    CC += ((startPeriod + 1) * periodLength - s.sol[v][i].T) * elecPrices[startPeriod];
-                    CC += (s.sol[v][i].T + s.sol[v][i].w - endPeriod * periodLength) * elecPrices[endPeriod];
-                    // Calculate cost for inbetween periods
-                    for (int j = startPeriod + 1; j < endPeriod; j++) {
-                        CC += periodLength * elecPrices[j];
-                    }
-                }
-                
+                // Price of the charging session over the periods it spans
+                CC += prices.Cost(s.sol[v][i].T, s.sol[v][i].w);
             }
         }
     }
@@ -429,14 +352,87 @@ double objFct(TSol s, std::vector <TNode>& node, std::vector <std::vector <doubl
     return weights[0] * TRT + weights[1] * ERT + weights[2] * CC + penalty * 10000;
 }
 
-std::vector <int> AssignFinalDepots(std::vector<TVecRk> rkVec, int nbUsers, int nbVehicles, std::vector<int> fDepotIDs, std::vector <std::vector <double> > dist) {
-    std::vector <int> fDepotAssigned(nbVehicles, -1);
+double RouteBound(const TRoute& route, const TProblem& problem) {
+    const std::vector <TNode>& node = problem.node;
+    const TMatrix& dist = problem.dist;
+    const double* weights = problem.weights;
+    int nbUsers = problem.nbUsers;
+
+    static thread_local std::vector <double> pickUpEnd; // elapsed time at the end of the service of each pick-up
+    pickUpEnd.resize(nbUsers);
+
+    const int* stop = route.stop;
+    double TRT = 0;
+    double ERT = 0;
+    double elapsed = 0; // travel and service time along the route, without waiting
+    for (int k = 1; k < (int)route.size(); k++) {
+        elapsed += dist[stop[k - 1]][stop[k]];
+        TRT += dist[stop[k - 1]][stop[k]];
+        if (stop[k] < nbUsers) { // Pick-up
+            pickUpEnd[stop[k]] = elapsed + node[stop[k]].d;
+        }
+        else if (stop[k] < 2 * nbUsers) { // Drop-off: the ride takes at least the travel and service time since the pick-up
+            ERT += elapsed - pickUpEnd[stop[k] - nbUsers] - dist[stop[k] - nbUsers][stop[k]];
+        }
+        elapsed += node[stop[k]].d;
+    }
+    return weights[0] * TRT + weights[1] * ERT;
+}
+
+void DecodeSignature(const std::vector <TKey>& keys, int n, const TProblem& problem, bool portfolio, std::vector <int>& signature) {
+    int nbVehicles = problem.nbVehicles;
+    int nbUsers = problem.nbUsers;
+
+    // Same gene choices as in Decoder() and Scheduler()
+    int numSchedulers = 2;
+    int numChargingPriorities = 5;
+    int dec = ceil(keys[n] * numDecoders + 0.000000000001);
+    int sched = ceil(keys[keys.size() - 2] * numSchedulers + 0.000000000001);
+    int chargingPriority = ceil(keys[keys.size() - 3] * numChargingPriorities + 0.000000000001);
+
+    signature.clear();
+    signature.push_back(dec);
+    if (!portfolio) { // PortfolioScheduler() tries all of them
+        signature.push_back(sched);
+        signature.push_back(chargingPriority);
+    }
+
+    // Insertion order of the users and the vehicle of each user
+    static thread_local std::vector <int> order;
+    ArgSortKeys(keys.data(), nbUsers, order);
+    for (int i = 0; i < nbUsers; i++) {
+        signature.push_back(order[i] * nbVehicles + (int)floor(keys[order[i]] * nbVehicles));
+    }
+
+    // Final depot of each vehicle
+    static thread_local std::vector <int> fDepAss;
+    AssignFinalDepots(keys, problem, fDepAss);
+    signature.insert(signature.end(), fDepAss.begin(), fDepAss.end());
+
+    // The RK-based pick-up times (scheduler 2) and the RK-based charging priority (4) use the values of the request and vehicle keys
+    if (portfolio || sched == 2 || chargingPriority == 4) {
+        int words = sizeof(TKey) / sizeof(int);
+        int first = signature.size();
+        signature.resize(first + (2 * nbUsers + nbVehicles) * words);
+        std::memcpy(&signature[first], keys.data(), (2 * nbUsers + nbVehicles) * sizeof(TKey));
+    }
+}
+
+void AssignFinalDepots(const std::vector <TKey>& keys, const TProblem& problem, std::vector <int>& fDepotAssigned) {
+    const TMatrix& dist = problem.dist;
+    const std::vector <int>& fDepotIDs = problem.fDepotIDs;
+    int nbVehicles = problem.nbVehicles;
+    int nbUsers = problem.nbUsers;
+
+    fDepotAssigned.assign(nbVehicles, -1);
     int matchingDepot = -1;
-    sort(rkVec.begin() + 2 * nbUsers, rkVec.begin() + 2 * nbUsers + nbVehicles, sortByRk); // Sort vehicles by random key
+    static thread_local std::vector <int> order;
+    ArgSortKeys(keys.data() + 2 * nbUsers, nbVehicles, order); // Order vehicles by random key
 
     // Go over each vehicle and assign the matching final depot, if not yet assigned, else closest to matching depot
-    for (int i = 2*nbUsers; i < 2*nbUsers + nbVehicles; i++) {
-        matchingDepot = fDepotIDs[floor(rkVec[i].rk * fDepotIDs.size())] -1; // -1 because first node has index 0 instead of 1 and so on
+    for (int k = 0; k < nbVehicles; k++) {
+        int v = order[k];
+        matchingDepot = fDepotIDs[floor(keys[2 * nbUsers + v] * fDepotIDs.size())] -1; // -1 because first node has index 0 instead of 1 and so on
         if (std::count(fDepotAssigned.begin(), fDepotAssigned.end(), matchingDepot)) { // if depot has already been assigned
             // Find closest final depot that has not been assigned yet
             double smallestDist = INFINITO;
@@ -453,10 +449,48 @@ std::vector <int> AssignFinalDepots(std::vector<TVecRk> rkVec, int nbUsers, int
             matchingDepot = newMatchDepot;
         }
         // Assign the matching depot to the vehicle
-        fDepotAssigned[rkVec[i].user] = matchingDepot;
+        fDepotAssigned[v] = matchingDepot;
     }
+}
 
-    sort(rkVec.begin() + 2 * nbUsers, rkVec.begin() + 2 * nbUsers + nbVehicles, sortByUser); // Sort vehicles by user again (to not hinder cross-over)
+void ArgSortKeys(const TKey* keys, int count, std::vector <int>& order) {
+    order.resize(count);
+    for (int i = 0; i < count; i++) order[i] = i;
+
+    // LSD radix sort (4 passes of 8 bits) on the keys quantized to 32 bits. Keys are in [0,1).
+    // Short lists (one route or the vehicles) are left to the insertion pass below.
+    if (count >= 64) {
+        static thread_local std::vector <uint32_t> quant, quantAux;
+        static thread_local std::vector <int> orderAux;
+        quant.resize(count);
+        quantAux.resize(count);
+        orderAux.resize(count);
+        for (int i = 0; i < count; i++) {
+            double scaled = (double)keys[i] * 4294967296.0;
+            quant[i] = scaled <= 0 ? 0 : scaled >= 4294967295.0 ? 4294967295u : (uint32_t)scaled;
+        }
+        for (int shift = 0; shift < 32; shift += 8) {
+            int bucket[257] = { 0 };
+            for (int i = 0; i < count; i++) bucket[((quant[i] >> shift) & 255) + 1]++;
+            for (int b = 0; b < 256; b++) bucket[b + 1] += bucket[b];
+            for (int i = 0; i < count; i++) {
+                int pos = bucket[(quant[i] >> shift) & 255]++;
+                quantAux[pos] = quant[i];
+                orderAux[pos] = order[i];
+            }
+            quant.swap(quantAux);
+            order.swap(orderAux);
+        }
+    }
 
-    return fDepotAssigned;
+    // Insertion pass: sorts short lists, and after the radix sort only reorders keys that quantized to the same value
+    for (int i = 1; i < count; i++) {
+        int pos = order[i];
+        int j = i;
+        while (j > 0 && keys[order[j - 1]] > keys[pos]) {
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = pos;
+    }
 }
@@ -7,46 +7,87 @@
 #include <math.h>
 #include <algorithm>
 #include "Data.h"
+#include "RouteTiming.h"
 #include "Scheduler.h"
 
 
 /************************************************************************************
  Method: Decoder()
- Description: Convert a random key solution in a real problem solution
+ Description: Convert a random key solution in a real problem solution. If bound < INFINITY,
+ decoding stops as soon as the objective value cannot get below bound anymore: the solution
+ is then flagged dominated and fo is set to the lower bound (needs problem.metric).
+ If parent is not nullptr, routes resume from the snapshots of its decode trace where they
+ start with the same users; the result is the same as decoding from scratch. If trace is not
+ nullptr, it is filled with the trace of this decoding. Both may be nullptr.
+ If portfolio, the routes are scheduled by PortfolioScheduler() instead of Scheduler().
 *************************************************************************************/
-TSol Decoder(TSol s, int n, std::vector <TNode> node,
-    std::vector <std::vector <double> > dist, std::vector <TVhcl> vehicle,
-    int nbVehicles, int nbUsers, int periodLength, int H, std::vector <int> oDepotIDs, std::vector <int> fDepotIDs,
-    std::vector <TCstat> cStations, std::vector <int> maxRideTimes, double weights[3], std::vector <double> elecPrices, std::vector <std::vector <double> > cons);
+TSol Decoder(TSol s, int n, const TProblem& problem, double bound, const TDecodeTrace* parent, TDecodeTrace* trace, bool portfolio);
 
 
 /************************************************************************************
- Method: Dec1
- Description: standard decoder 
+ Type: TDecoderFct
+ Description: decoder turning the random keys into routes (see Decoder)
 *************************************************************************************/
-TSol Dec1(TSol s, int n, std::vector <TNode> node,
-    std::vector <std::vector <double> > dist, std::vector <TVhcl> vehicle,
-    int nbVehicles, int nbUsers, int periodLength, int H, std::vector <int> oDepotIDs, std::vector <int> fDepotIDs,
-    std::vector <TCstat> cStations, std::vector <int> maxRideTimes, double weights[3], std::vector <double> elecPrices, std::vector <std::vector <double> > cons);
+typedef TSol (*TDecoderFct)(TSol s, int n, const TProblem& problem, double bound, const TDecodeTrace* parent, TDecodeTrace* trace);
+
+/************************************************************************************
+ Method: InsertionDecoder
+ Description: standard decoder: in ascending order of their keys, users are assigned to a
+ vehicle and their pick-up and drop-off are inserted at the cheapest feasible positions. The
+ routes are built one vehicle at a time (a user only changes its own route), with the result
+ of inserting all users in key order, including the penalty when one cannot be inserted.
+ pickUpFirst inserts the pick-up first and searches the drop-off after it; otherwise the
+ drop-off is inserted first and the pick-up is searched before it. parent and trace as in
+ Decoder (parent is nullptr unless it was built by the same variant). Instantiated in Decoder.cpp.
+*************************************************************************************/
+template <bool pickUpFirst>
+TSol InsertionDecoder(TSol s, int n, const TProblem& problem, double bound, const TDecodeTrace* parent, TDecodeTrace* trace);
+
 /************************************************************************************
- Method: Dec2
- Description: standard decoder 
+ Method: InsertRequest
+ Description: inserts the pick-up and drop-off of user in route at their cheapest feasible
+ positions, in the order of InsertionDecoder<pickUpFirst>; timing holds the state of route and
+ is kept up to date. Returns false, with route and timing unchanged, if one of them cannot be inserted.
 *************************************************************************************/
-TSol Dec2(TSol s, int n, std::vector <TNode> node,
-    std::vector <std::vector <double> > dist, std::vector <TVhcl> vehicle,
-    int nbVehicles, int nbUsers, int periodLength, int H, std::vector <int> oDepotIDs, std::vector <int> fDepotIDs,
-    std::vector <TCstat> cStations, std::vector <int> maxRideTimes, double weights[3], std::vector <double> elecPrices, std::vector <std::vector <double> > cons);
+template <bool pickUpFirst>
+bool InsertRequest(TRoute& route, TRouteTiming& timing, int user, const TProblem& problem);
 
 /************************************************************************************
  Method: objFct
  Description: calculates the objective function value
 *************************************************************************************/
-double objFct(TSol s, std::vector <TNode> &node, std::vector <std::vector <double> > &dist, int nbVehicles, int nbUsers, int periodLength, std::vector <int> maxRideTimes, double weights[3], std::vector <double> elecPrices);
+double objFct(const TSol& s, const TProblem& problem);
+
+/************************************************************************************
+ Method: RouteBound
+ Description: lower bound on the contribution of a route (with complete requests only) to objFct:
+ weights[0] * travel time + weights[1] * excess ride time, each ride taking at least the travel
+ and service time between pick-up and drop-off. Inserting stops (or charging stations) can only
+ increase it if the travel times satisfy the triangle inequality.
+*************************************************************************************/
+double RouteBound(const TRoute& route, const TProblem& problem);
+
+/************************************************************************************
+ Method: DecodeSignature
+ Description: fills signature with the parts of the random keys that Decoder() reads (decoder,
+ scheduler and charging priority choice, user order and vehicles, final depots, and the key
+ values when the scheduler uses them). Keys with the same signature decode to the same solution.
+ If portfolio, as read by Decoder() with portfolio: the scheduler and charging priority keys are
+ left out and the key values are always included.
+*************************************************************************************/
+void DecodeSignature(const std::vector <TKey>& keys, int n, const TProblem& problem, bool portfolio, std::vector <int>& signature);
 
 /************************************************************************************
  Method: AssignFinalDepots
- Description: returns vector with the assigned depot for vehicle 0 at index 0, vehicle 1 at index 1, ...
+ Description: fills fDepotAssigned with the assigned depot for vehicle 0 at index 0, vehicle 1 at index 1, ...
+*************************************************************************************/
+void AssignFinalDepots(const std::vector <TKey>& keys, const TProblem& problem, std::vector <int>& fDepotAssigned);
+
+/************************************************************************************
+ Method: ArgSortKeys
+ Description: fills order with the positions 0..count-1 of keys sorted by increasing key
+ (equal keys by position). The keys themselves are not moved.
 *************************************************************************************/
-std::vector <int> AssignFinalDepots(std::vector<TVecRk> rkVec, int nbUsers, int nbVehicles, std::vector<int> fDepotIDs, std::vector <std::vector <double> > dist);
+void ArgSortKeys(const TKey* keys, int count, std::vector <int>& order);
 
 #endif
\ No newline at end of file
@@ -9,24 +9,7 @@
 //------ DEFINITION OF GLOBAL CONSTANTS AND VARIABLES OF PROBLEM SPECIFIC --------
 
 //Problem specific data
-std::vector <std::vector <double> > dist;	// matrix with Euclidean distance
-
-std::vector <std::vector <double> > cons;  // matrix with battery consumption
-
-std::vector <TNode> node;					// vector of CC-e-ADARP nodes (Pick-ups, Drop-offs, Origin depots, Final depots, Charging stations)
-
-std::vector <TVhcl> vehicle;                // vector of vehicles
-
-int nbVehicles;                             // #Vehicles
-int nbUsers;                                // #Users
-int periodLength;                           // Length in mins of one period with constant electricity price
-int H;                                      // Planning horizon (mins)
-std::vector <int> oDepotIDs;                // Origin depots IDs (only "artificial" ones) 
-std::vector <int> fDepotIDs;                // Final depots IDs (only "artificial" ones) 
-std::vector <TCstat> cStations;             // Charging stations
-std::vector <int> maxRideTimes;             // Users maximum ride times
-double weights[3];                          // Objective function weights
-std::vector <double> elecPrices;             // Electricity prices
+TProblem problem;                           // instance data (read-only once ReadData() has filled it)
 
 
 
@@ -41,6 +24,8 @@ std::mt19937 rng(std::chrono::steady_clock::now().time_since_epoch().count());
 // Input File
 int debug = 1;                              // 0 - run mode      		    1 - debug mode
 int ls = 1;  				                // 0 - without local search     1 - with local search
+int prune = 0;                              // 0 - decode all offspring     1 - stop decoding offspring that cannot enter the elite set
+int portfolio = 0;                          // 0 - policies of the keys     1 - try all charging priorities and schedulers, keep the best in the keys
 int MAXTIME = 1;                            // maximum runtime
 int MAXRUNS =  1;                           // maximum number of runs of the method
 unsigned MAX_THREADS = 1;            		// number of threads
@@ -68,14 +53,27 @@ int stagnation;                             // number of generations without imp
 double beta;                                // perturbation intensity
 double sigma;                               // pearson correlation factor
 
-std::vector <TSol> Pop;                      	// current population
-std::vector <TSol> PopInter;               		// intermediary population
+TPopulation Pop;                      	    // current population (keys and fitness)
+TPopulation PopInter;               		// intermediary population (swapped with Pop at the end of a generation)
+
+TSol bestSolution;                          // best solution found in the A-BRKGA (merged from threadBest by MergeBestSolutions)
+std::atomic <double> bestFo;                // fo of the best solution found by any thread
+std::vector <TSol> threadBest;              // best solution found by each thread since the last merge
+std::vector <clock_t> threadBestTime;       // time at which each thread found its threadBest
+
+thread_local TSol decodeSol;                // per-thread solution the individuals are decoded in (keeps its storage between decodes)
+thread_local TDecodeTrace decodeTrace;      // per-thread decode trace of an offspring, kept only if it can be an elite parent
+
+// Compile with -DFITNESS_CACHE to look the fitness of an individual up by its decode signature before decoding it
+// (off by default: only about 1% of the decodes repeat a signature, which does not pay for computing it)
+TFitnessCache fitnessCache;                 // recently decoded solutions by decode signature (reset every run)
+
 
-TSol bestSolution;                          // best solution found in the A-BRKGA
+std::vector <int> rankOrder;                // rows of Pop by fitness: the elites sorted, then the others
 
 
-// Sort TSol by objective function
-bool sortByFitness(const TSol &lhs, const TSol &rhs) { return lhs.fo < rhs.fo; }
+// Sort rows of Pop by objective function
+bool sortByFitness(int lhs, int rhs) { return Pop.fo[lhs] < Pop.fo[rhs]; }
 
 
 // Reinforcement Learning
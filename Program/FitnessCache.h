@@ -0,0 +1,137 @@
+//#pragma once
+#ifndef _FITNESSCACHE_H
+#define _FITNESSCACHE_H
+
+#include <vector>
+#include <cstdint>
+#include "Data.h"
+
+/************************************************************************************
+ Struct: TFitnessCache
+ Description: bounded cache of decoded solutions, keyed by the decode signature of the
+ random keys (see DecodeSignature): chromosomes with the same signature decode to the
+ same solution, so a hit saves a call to Decoder(). The cache is 4-way set associative
+ with LRU eviction inside a set; entries are compared on the whole signature, so a hash
+ collision is a miss and never a wrong fitness. The routes are only kept for solutions
+ that were stored with them (the population only needs the fitness). Lookup and Store
+ may be called from several threads. The cache must be reset when the instance changes.
+*************************************************************************************/
+struct TFitnessCache
+{
+    static const int ways = 4;
+
+    struct TEntry
+    {
+        std::uint64_t hash = 0;
+        unsigned long long stamp = 0;           // last use, 0 if the entry is empty
+        std::vector <int> signature;
+        double fo = 0;
+        int battery_infeasibles = 0;
+        bool scheduled = false;
+        bool hasRoutes = false;                 // sol holds the routes of the solution
+        TKey priorityKey = 0;                   // charging priority and scheduler keys of the solution
+        TKey schedulerKey = 0;
+        std::vector <TRoute> sol;
+    };
+
+    std::vector <TEntry> entries;               // nbSets x ways entries
+    int nbSets = 0;
+    unsigned long long clock = 0;
+    long long hits = 0;
+    long long misses = 0;
+
+    // Empties the cache and sizes it to hold (at least) nbEntries solutions
+    void Reset(int nbEntries)
+    {
+        nbSets = 1;
+        while (nbSets * ways < nbEntries) nbSets *= 2;
+        entries.clear();
+        entries.resize(nbSets * ways);
+        clock = 0;
+        hits = 0;
+        misses = 0;
+    }
+
+    static std::uint64_t Hash(const std::vector <int>& signature)
+    {
+        std::uint64_t h = 14695981039346656037ULL; // FNV-1a
+        for (int v : signature) {
+            h ^= (std::uint32_t)v;
+            h *= 1099511628211ULL;
+        }
+        return h ^ (h >> 29);
+    }
+
+    // On a hit, sets fo and the infeasibility indicators of s to the cached solution. The routes are
+    // needed too if withRoutes, or if the cached fo is below bestFo (a new best solution keeps its
+    // routes); an entry without routes is then a miss. If withPolicy, the charging priority and scheduler
+    // keys of s are set to the ones of the cached solution too (see PortfolioScheduler)
+    bool Lookup(const std::vector <int>& signature, TSol& s, bool withRoutes, double bestFo, bool withPolicy)
+    {
+        std::uint64_t hash = Hash(signature);
+        bool found = false;
+
+        #pragma omp critical (fitnessCache)
+        {
+            TEntry* set = &entries[(hash & (nbSets - 1)) * ways];
+            for (int w = 0; w < ways; w++) {
+                TEntry& e = set[w];
+                if (e.stamp > 0 && e.hash == hash && e.signature == signature) {
+                    bool needRoutes = withRoutes || e.fo < bestFo;
+                    if (needRoutes && !e.hasRoutes) break;
+                    e.stamp = ++clock;
+                    s.fo = e.fo;
+                    s.battery_infeasibles = e.battery_infeasibles;
+                    s.scheduled = e.scheduled;
+                    if (needRoutes) s.sol = e.sol;
+                    if (withPolicy) {
+                        s.vec[s.vec.size() - 3] = e.priorityKey;
+                        s.vec[s.vec.size() - 2] = e.schedulerKey;
+                    }
+                    found = true;
+                    break;
+                }
+            }
+            if (found) hits++;
+            else misses++;
+        }
+        return found;
+    }
+
+    // Saves the decoded solution s (its routes if withRoutes) under signature, evicting the least recently used entry of its set
+    void Store(const std::vector <int>& signature, const TSol& s, bool withRoutes)
+    {
+        std::uint64_t hash = Hash(signature);
+
+        #pragma omp critical (fitnessCache)
+        {
+            TEntry* set = &entries[(hash & (nbSets - 1)) * ways];
+            TEntry* victim = &set[0];
+            for (int w = 0; w < ways; w++) {
+                TEntry& e = set[w];
+                if (e.stamp > 0 && e.hash == hash && e.signature == signature) { // stored by another thread meanwhile
+                    victim = &e;
+                    break;
+                }
+                if (e.stamp < victim->stamp) victim = &e;
+            }
+            if (victim->stamp == 0 || victim->hash != hash || victim->signature != signature) {
+                victim->hash = hash;
+                victim->signature = signature;
+                victim->hasRoutes = false;
+            }
+            victim->stamp = ++clock;
+            victim->fo = s.fo;
+            victim->battery_infeasibles = s.battery_infeasibles;
+            victim->scheduled = s.scheduled;
+            victim->priorityKey = s.vec[s.vec.size() - 3];
+            victim->schedulerKey = s.vec[s.vec.size() - 2];
+            if (withRoutes) {
+                victim->sol = s.sol;
+                victim->hasRoutes = true;
+            }
+        }
+    }
+};
+
+#endif
@@ -1,21 +1,40 @@
 #include "LocalSearch.h"
 
-// Sort TSol by random-keys
-bool sortByRkLS(const TVecRk& lhs, const TVecRk& rhs) { return lhs.rk < rhs.rk; }
+// Charging decisions of the routes scheduled during the current LocalSearch() call (the neighbours change one or two routes)
+static thread_local TScheduleCache scheduleCache;
 
-// Sort TSol by user
-bool sortByUserLS(const TVecRk& lhs, const TVecRk& rhs) { return lhs.user < rhs.user; }
+// Routes reused from and scheduled into the schedule caches of all threads since the last TakeScheduleCacheCounts()
+static std::atomic <long long> scheduleCacheHits(0);
+static std::atomic <long long> scheduleCacheMisses(0);
 
-TSol LocalSearch(TSol s, int n, std::vector <TNode>& node,
-    std::vector <std::vector <double> >& dist, std::vector <TVhcl> vehicle,
-    int nbVehicles, int nbUsers, int periodLength, int H, std::vector <int> oDepotIDs, std::vector <int> fDepotIDs,
-    std::vector <TCstat> cStations, std::vector <int> maxRideTimes, double weights[3], std::vector <double> elecPrices, std::vector <std::vector <double> >& cons)
+// Adds the counts of the schedule cache of this thread to the totals
+static void CountScheduleCache()
 {
+    scheduleCacheHits += scheduleCache.hits;
+    scheduleCacheMisses += scheduleCache.misses;
+    scheduleCache.hits = 0;
+    scheduleCache.misses = 0;
+}
+
+void TakeScheduleCacheCounts(long long& hits, long long& misses)
+{
+    hits = scheduleCacheHits.exchange(0);
+    misses = scheduleCacheMisses.exchange(0);
+}
+
+TSol LocalSearch(TSol s, int n, const TProblem& problem)
+{
+    const std::vector <TNode>& node = problem.node;
+    int nbVehicles = problem.nbVehicles;
+    int nbUsers = problem.nbUsers;
+
+    scheduleCache.Reset(nbVehicles);
+
     // If obj value > 999999, not all requests could feasibly be inserted
     // Try to insert un-inserted requests in other routes than the rk-decided route
     if (s.fo > 999999) {
-        s = Insertion(s, n, node, dist, vehicle, nbVehicles, nbUsers, periodLength, H, oDepotIDs, fDepotIDs, cStations, maxRideTimes, weights, elecPrices, cons);
-        if (s.fo > 999999) { return s; } // If still not feasible, just return
+        s = Insertion(std::move(s), n, problem);
+        if (s.fo > 999999) { CountScheduleCache(); return s; } // If still not feasible, just return
         // Else, if it IS feasible now, continue with LS
     }
 
@@ -24,7 +43,7 @@ TSol LocalSearch(TSol s, int n, std::vector <TNode>& node,
         for (int j = 0; j < s.sol[i].size(); j++) {
             if (s.sol[i][j].stop >= nbUsers * 2) { // If not a pick-up or drop-off
                 if (s.sol[i][j].c_station == true) { // If charging station
-                    s.sol[i].erase(s.sol[i].begin() + j); // Remove stop
+                    s.sol[i].erase(j); // Remove stop
                     j--; // Set j one back, since now a new element stands at spot j
                 }
                 else { // If depot
@@ -45,7 +64,7 @@ TSol LocalSearch(TSol s, int n, std::vector <TNode>& node,
         s.sol[i][0].LT = node[s.sol[i][0].stop].dep; // Origin depot
         s.sol[i][s.sol[i].size()-1].ET = node[s.sol[i][s.sol[i].size()-1].stop].arr; // Final depot
         s.sol[i][s.sol[i].size()-1].LT = node[s.sol[i][s.sol[i].size()-1].stop].dep; // Final depot
-        if (!UpdateETForwards(s.sol[i], 1, dist, node) || !UpdateLTBackwards(s.sol[i], s.sol[i].size() - 2, dist, node)) {
+        if (!UpdateETForwards(s.sol[i], 1, problem) || !UpdateLTBackwards(s.sol[i], s.sol[i].size() - 2, problem)) {
             // This point should not be reached. If it is, it means a ET-LT overlap has indicated an infeasibility, which should not be possible
             int error = 666;
         }
@@ -77,19 +96,19 @@ TSol LocalSearch(TSol s, int n, std::vector <TNode>& node,
         switch (k)
         {
         case 1: 
-            s = LS1(s, node, dist, vehicle, nbUsers, nbVehicles, periodLength, cStations, maxRideTimes, weights, elecPrices, cons); // Consecutive node swap
+            s = LS1(std::move(s), problem); // Consecutive node swap
             break;
 
         case 2:
-            s = LS2(s, node, dist, vehicle, nbUsers, nbVehicles, periodLength, cStations, maxRideTimes, weights, elecPrices, cons); // Random feasible 2-opt
+            s = LS2(std::move(s), problem); // Random feasible 2-opt
             break;
 
         case 3:
-            s = LS3(s, n, node, dist, vehicle, nbVehicles, nbUsers, periodLength, H, oDepotIDs, fDepotIDs, cStations, maxRideTimes, weights, elecPrices, cons); // Exhaustive relocate;
+            s = LS3(std::move(s), n, problem); // Exhaustive relocate;
             break;
 
         case 4:
-            s = LS4(s, n, node, dist, vehicle, nbVehicles, nbUsers, periodLength, H, oDepotIDs, fDepotIDs, cStations, maxRideTimes, weights, elecPrices, cons); // Random feasible exchange
+            s = LS4(std::move(s), n, problem); // Random feasible exchange
         
         default:
             break;
@@ -113,17 +132,23 @@ TSol LocalSearch(TSol s, int n, std::vector <TNode>& node,
     // Final version has NO schedule and charging stops, in order to keep iteratively applying LS possible.
     // However, fo has been set to fo AFTER scheduling
     // Before returning, schedule has to be set again & charging station need to be implemented
-    s = Scheduler(s, node, dist, vehicle, nbUsers, nbVehicles, periodLength, cStations, maxRideTimes, weights, elecPrices, cons);
+    s = Scheduler(std::move(s), problem, &scheduleCache);
+    CountScheduleCache();
  	return s;
 }
 
-TSol LS1(TSol s, std::vector <TNode> &node, std::vector <std::vector <double> >& dist, std::vector <TVhcl> vehicle, int nbUsers,
-    int nbVehicles, int periodLength, std::vector <TCstat> cStations, std::vector <int> maxRideTimes, double weights[3], std::vector <double> elecPrices, std::vector <std::vector <double> > &cons)
+TSol LS1(TSol s, const TProblem& problem)
 {
-    TSol tempSol;
-    TSol schedSol; // A copy of the solution to schedule. Else, a solution WITH charging stations could be passed on to next LS, causing issues
+    const std::vector <TNode>& node = problem.node;
+    const TMatrix& dist = problem.dist;
+    int nbVehicles = problem.nbVehicles;
+    int nbUsers = problem.nbUsers;
+
+    // Work copies are kept per thread, so resetting them reuses their storage
+    static thread_local TSol tempSol;
+    static thread_local TSol schedSol; // A copy of the solution to schedule. Else, a solution WITH charging stations could be passed on to next LS, causing issues
     TSol bestSol = s;
-    std::vector<TVecSol> tempRoute;
+    static thread_local TRoute tempRoute;
     int aux;
     bool feasible;
 
@@ -153,33 +178,10 @@ TSol LS1(TSol s, std::vector <TNode> &node, std::vector <std::vector <double> >&
                     continue;
                 }
                 else {
-                    feasible = true;
-                    // If tightened window does not indicate infeasibility, update ET and LT of other stops and check feasibility again
-                    // Update LT "backwards" as long as needed
-                    for (int k = i - 1; k > 0; k--) {
-                        if (tempRoute[k + 1].LT - dist[tempRoute[k].stop][tempRoute[k + 1].stop] - node[tempRoute[k].stop].d < tempRoute[k].LT) { // If LT needs to be updated
-                            tempRoute[k].LT = tempRoute[k + 1].LT - dist[tempRoute[k].stop][tempRoute[k + 1].stop] - node[tempRoute[k].stop].d; // Update LT
-                            // Check new tightened window
-                            if (tempRoute[k].LT < tempRoute[k].ET) {
-                                feasible = false;
-                                break;
-                            }
-                        }
-                        else break; // Else, you can stop backwards updating
-                    }
-                    // IF STILL FEASIBLE, update ET "forwards" as long as needed
+                    // If tightened window does not indicate infeasibility, update LT "backwards" (not the origin depot) and ET "forwards" as long as needed and check feasibility again
+                    feasible = TightenLT(tempRoute, i - 1, 1, problem);
                     if (feasible) {
-                        for (int k = i + 2; k < tempRoute.size(); k++) {
-                            if (tempRoute[k - 1].ET + dist[tempRoute[k - 1].stop][tempRoute[k].stop] + node[tempRoute[k - 1].stop].d > tempRoute[k].ET) { // If ET needs to be updated
-                                tempRoute[k].ET = tempRoute[k - 1].ET + dist[tempRoute[k - 1].stop][tempRoute[k].stop] + node[tempRoute[k - 1].stop].d; // Update ET
-                                // Check new tightened window
-                                if (tempRoute[k].LT < tempRoute[k].ET) {
-                                    feasible = false;
-                                    break;
-                                }
-                            }
-                            else break; // Else, you can stop forwards updating
-                        }
+                        feasible = TightenET(tempRoute, i + 2, problem);
                     }
                     if (!feasible) continue; // If not a feasible swap, continue to next swap
                 }
@@ -187,13 +189,14 @@ TSol LS1(TSol s, std::vector <TNode> &node, std::vector <std::vector <double> >&
                 tempSol.sol[veh] = tempRoute;
 
                 // Update load capacity
-                CalculateLoadCapacity(tempSol, node);
+                CalculateLoadCapacity(tempSol, problem);
 
                 // Apply scheduler
-                schedSol = Scheduler(tempSol, node, dist, vehicle, nbUsers, nbVehicles, periodLength, cStations, maxRideTimes, weights, elecPrices, cons);
+                schedSol = tempSol;
+                schedSol = Scheduler(std::move(schedSol), problem, &scheduleCache);
 
                 // Calculate objective function
-                tempSol.fo = objFct(schedSol, node, dist, nbVehicles, nbUsers, periodLength, maxRideTimes, weights, elecPrices);
+                tempSol.fo = objFct(schedSol, problem);
 
                 // If obj function has improved, copy this solution to s
                 if (tempSol.fo < bestSol.fo) {
@@ -205,17 +208,22 @@ TSol LS1(TSol s, std::vector <TNode> &node, std::vector <std::vector <double> >&
     return bestSol;
 }
 
-TSol LS2(TSol s, std::vector <TNode>& node, std::vector <std::vector <double> >& dist, std::vector <TVhcl> vehicle, int nbUsers,
-    int nbVehicles, int periodLength, std::vector <TCstat> cStations, std::vector <int> maxRideTimes, double weights[3], std::vector <double> elecPrices, std::vector <std::vector <double> >& cons)
+TSol LS2(TSol s, const TProblem& problem)
 {
+    const std::vector <TNode>& node = problem.node;
+    const TMatrix& dist = problem.dist;
+    const std::vector <TVhcl>& vehicle = problem.vehicle;
+
     // Choose (different) 2 random routes
     int route1 = irand(0, s.sol.size() - 1);
     int route2 = irand(0, s.sol.size() - 1);
     while (route1 == route2) route2 = irand(0, s.sol.size() - 1);
 
     // Identify all zero-load points in each route
-    std::vector<int> zeroLoadsRoute1;
-    std::vector<int> zeroLoadsRoute2;
+    static thread_local std::vector<int> zeroLoadsRoute1;
+    static thread_local std::vector<int> zeroLoadsRoute2;
+    zeroLoadsRoute1.clear();
+    zeroLoadsRoute2.clear();
     for (int i = 1; i < s.sol[route1].size() - 1; i++) { // Find all zero-load points in route 1 (except depots)
         if (s.sol[route1][i].C == vehicle[route1].C) {
             zeroLoadsRoute1.push_back(i);
@@ -233,7 +241,8 @@ TSol LS2(TSol s, std::vector <TNode>& node, std::vector <std::vector <double> >&
     }
 
     // Identify (potentially) feasible zero-load points combo's
-    std::vector<std::vector<int>> zeroLoadCombos;
+    static thread_local std::vector<std::pair<int, int>> zeroLoadCombos;
+    zeroLoadCombos.clear();
     bool feasible = false;
     for (int i : zeroLoadsRoute1) {
         for (int j : zeroLoadsRoute2) {
@@ -251,53 +260,55 @@ TSol LS2(TSol s, std::vector <TNode>& node, std::vector <std::vector <double> >&
     }
 
     TSol bestSol = s;
-    TSol schedSol; // A copy of the solution to schedule. Else, a solution WITH charging stations could be passed on to next LS, causing issues
+    static thread_local TSol tempSol;
+    static thread_local TSol schedSol; // A copy of the solution to schedule. Else, a solution WITH charging stations could be passed on to next LS, causing issues
 
     // Check each feasible combo
-    for (std::vector<int> zeroLoadCombo : zeroLoadCombos) {
+    for (const std::pair<int, int>& zeroLoadCombo : zeroLoadCombos) {
         // Copy current solution
-        TSol tempSol = s;
+        tempSol = s;
 
         // Delete all stops after zero-load point in copy
-        int nbToPop = tempSol.sol[route1].size() - zeroLoadCombo[0] - 1;
+        int nbToPop = tempSol.sol[route1].size() - zeroLoadCombo.first - 1;
         for (int i = 0; i < nbToPop; i++) {
             tempSol.sol[route1].pop_back();
         }
-        nbToPop = tempSol.sol[route2].size() - zeroLoadCombo[1] - 1;
+        nbToPop = tempSol.sol[route2].size() - zeroLoadCombo.second - 1;
         for (int i = 0; i < nbToPop; i++) {
             tempSol.sol[route2].pop_back();
         }
 
         // Copy stops from after zero-load points from original solution
         // Route 1 to route 2 and vice versa
-        for (int i = zeroLoadCombo[0] + 1; i < s.sol[route1].size(); i++) {
+        for (int i = zeroLoadCombo.first + 1; i < s.sol[route1].size(); i++) {
             tempSol.sol[route2].push_back(s.sol[route1][i]);
         }
-        for (int i = zeroLoadCombo[1] + 1; i < s.sol[route2].size(); i++) {
+        for (int i = zeroLoadCombo.second + 1; i < s.sol[route2].size(); i++) {
             tempSol.sol[route1].push_back(s.sol[route2][i]);
         }
 
         // Update ET and LT
         //// Route1
         ////// Forwards ET updating
-        if (!UpdateETForwards(tempSol.sol[route1], zeroLoadCombo[0], dist, node)) return s; // If infeasibility found, return s
+        if (!UpdateETForwards(tempSol.sol[route1], zeroLoadCombo.first, problem)) return s; // If infeasibility found, return s
         ////// Backwards LT updating
-        if (!UpdateLTBackwards(tempSol.sol[route1], zeroLoadCombo[0], dist, node)) return s; // If infeasibility found, return s
+        if (!UpdateLTBackwards(tempSol.sol[route1], zeroLoadCombo.first, problem)) return s; // If infeasibility found, return s
 
         //// Route2
         ////// Forwards ET updating
-        if (!UpdateETForwards(tempSol.sol[route2], zeroLoadCombo[1], dist, node)) return s; // If infeasibility found, return s
+        if (!UpdateETForwards(tempSol.sol[route2], zeroLoadCombo.second, problem)) return s; // If infeasibility found, return s
         ////// Backwards LT updating
-        if (!UpdateLTBackwards(tempSol.sol[route2], zeroLoadCombo[1], dist, node)) return s; // If infeasibility found, return s
+        if (!UpdateLTBackwards(tempSol.sol[route2], zeroLoadCombo.second, problem)) return s; // If infeasibility found, return s
 
         // Update load capacities
-        CalculateLoadCapacity(tempSol, node);
+        CalculateLoadCapacity(tempSol, problem);
 
         // Schedule
-        schedSol = Scheduler(tempSol, node, dist, vehicle, nbUsers, nbVehicles, periodLength, cStations, maxRideTimes, weights, elecPrices, cons);
+        schedSol = tempSol;
+        schedSol = Scheduler(std::move(schedSol), problem, &scheduleCache);
 
         // Calculate obj function
-        tempSol.fo = objFct(schedSol, node, dist, nbVehicles, nbUsers, periodLength, maxRideTimes, weights, elecPrices);
+        tempSol.fo = objFct(schedSol, problem);
 
         // Return new solution only if better objective function
         if (tempSol.fo < bestSol.fo) {
@@ -308,27 +319,25 @@ TSol LS2(TSol s, std::vector <TNode>& node, std::vector <std::vector <double> >&
     return bestSol;
 }
 
-TSol LS3(TSol s, int n, std::vector <TNode>& node,
-    std::vector <std::vector <double> >& dist, std::vector <TVhcl> vehicle,
-    int nbVehicles, int nbUsers, int periodLength, int H, std::vector <int> oDepotIDs, std::vector <int> fDepotIDs,
-    std::vector <TCstat> cStations, std::vector <int> maxRideTimes, double weights[3], std::vector <double> elecPrices, std::vector <std::vector <double> >& cons) {
+TSol LS3(TSol s, int n, const TProblem& problem) {
+    int nbUsers = problem.nbUsers;
 
     // Choose 1 random route
     int route = irand(0, s.sol.size() - 1);
 
     // Iterate over all users in this route and try inserting into different route
     TSol bestSol = s;
-    TSol tempSol;
-    TSol schedSol; // A copy of the solution to schedule. Else, a solution WITH charging stations could be passed on to next LS, causing issues
-    TSol auxSol;
-    TSol auxBest;
+    static thread_local TSol tempSol;
+    static thread_local TSol schedSol; // A copy of the solution to schedule. Else, a solution WITH charging stations could be passed on to next LS, causing issues
+    static thread_local TSol auxSol;
+    static thread_local TSol auxBest;
 
     for (int i = 1; i < s.sol[route].size() - 1; i++) { // For each user in the route (except depots)
         tempSol = s; // Reset tempSol
         if (s.sol[route][i].stop < nbUsers) { // If pick-up node
 
             // Delete pick-up and drop-off from route
-            RemoveRequest(tempSol.sol[route], i, nbUsers, dist, node);
+            RemoveRequest(tempSol.sol[route], i, problem);
 
             // Try inserting in different routes
             auxBest = bestSol;
@@ -337,10 +346,11 @@ TSol LS3(TSol s, int n, std::vector <TNode>& node,
                 else {
                     auxSol = tempSol;
                     // Insert user in cheapest feasible place
-                    if (BestFeasibleInsertion(auxSol.sol[veh], s.sol[route][i].stop, nbUsers, dist, node)) { // If user could be feasibly inserted in the route
-                        CalculateLoadCapacity(auxSol, node);
-                        schedSol = Scheduler(auxSol, node, dist, vehicle, nbUsers, nbVehicles, periodLength, cStations, maxRideTimes, weights, elecPrices, cons); // Schedule auxSol
-                        auxSol.fo = objFct(schedSol, node, dist, nbVehicles, nbUsers, periodLength, maxRideTimes, weights, elecPrices); // Calculate new objective value
+                    if (BestFeasibleInsertion(auxSol.sol[veh], s.sol[route][i].stop, problem)) { // If user could be feasibly inserted in the route
+                        CalculateLoadCapacity(auxSol, problem);
+                        schedSol = auxSol;
+                        schedSol = Scheduler(std::move(schedSol), problem, &scheduleCache); // Schedule auxSol
+                        auxSol.fo = objFct(schedSol, problem); // Calculate new objective value
                         if (auxSol.fo < auxBest.fo) { // If insertion of user 'i' into route 'veh' is new best, save. 
                             auxBest = auxSol;
                         }
@@ -360,13 +370,12 @@ TSol LS3(TSol s, int n, std::vector <TNode>& node,
     return bestSol;
 }
 
-TSol LS4(TSol s, int n, std::vector <TNode> &node,
-    std::vector <std::vector <double> > &dist, std::vector <TVhcl> vehicle,
-    int nbVehicles, int nbUsers, int periodLength, int H, std::vector <int> oDepotIDs, std::vector <int> fDepotIDs,
-    std::vector <TCstat> cStations, std::vector <int> maxRideTimes, double weights[3], std::vector <double> elecPrices, std::vector <std::vector <double> >& cons) {
+TSol LS4(TSol s, int n, const TProblem& problem) {
+    int nbUsers = problem.nbUsers;
 
-    TSol tempSol = s;
-    TSol schedSol;
+    static thread_local TSol tempSol;
+    static thread_local TSol schedSol;
+    tempSol = s;
 
     // Exception catching
     // If there is only 1 route with at least 1 request, the exchange LS operator is impossible
@@ -412,13 +421,13 @@ TSol LS4(TSol s, int n, std::vector <TNode> &node,
     }
 
     // Delete requests from routes
-    int user1ID = RemoveRequest(tempSol.sol[route1], user1, nbUsers, dist, node);
-    int user2ID = RemoveRequest(tempSol.sol[route2], user2, nbUsers, dist, node);
+    int user1ID = RemoveRequest(tempSol.sol[route1], user1, problem);
+    int user2ID = RemoveRequest(tempSol.sol[route2], user2, problem);
 
     // Insert user1 into route2
-    if (BestFeasibleInsertion(tempSol.sol[route2], user1ID, nbUsers, dist, node)) {
+    if (BestFeasibleInsertion(tempSol.sol[route2], user1ID, problem)) {
         // Only if feasible insertion found for user1 in route2, insert user2 into route1
-        if (!BestFeasibleInsertion(tempSol.sol[route1], user2ID, nbUsers, dist, node)) {
+        if (!BestFeasibleInsertion(tempSol.sol[route1], user2ID, problem)) {
             // If no feasible insertion was found for user2 in route1, return s
             return s;
         }
@@ -427,9 +436,10 @@ TSol LS4(TSol s, int n, std::vector <TNode> &node,
         return s;
     }
 
-    CalculateLoadCapacity(tempSol, node);
-    schedSol = Scheduler(tempSol, node, dist, vehicle, nbUsers, nbVehicles, periodLength, cStations, maxRideTimes, weights, elecPrices, cons);
-    tempSol.fo = objFct(schedSol, node, dist, nbVehicles, nbUsers, periodLength, maxRideTimes, weights, elecPrices);
+    CalculateLoadCapacity(tempSol, problem);
+    schedSol = tempSol;
+    schedSol = Scheduler(std::move(schedSol), problem, &scheduleCache);
+    tempSol.fo = objFct(schedSol, problem);
     
     if (tempSol.fo < s.fo) {
         return tempSol;
@@ -439,24 +449,24 @@ TSol LS4(TSol s, int n, std::vector <TNode> &node,
     }
 }
 
-TSol Insertion(TSol s, int n, std::vector <TNode>& node,
-    std::vector <std::vector <double> >& dist, std::vector <TVhcl> vehicle,
-    int nbVehicles, int nbUsers, int periodLength, int H, std::vector <int> oDepotIDs, std::vector <int> fDepotIDs,
-    std::vector <TCstat> cStations, std::vector <int> maxRideTimes, double weights[3], std::vector <double> elecPrices, std::vector <std::vector <double> >& cons) {
+TSol Insertion(TSol s, int n, const TProblem& problem) {
+    int nbVehicles = problem.nbVehicles;
+    int nbUsers = problem.nbUsers;
 
     int nbUninsertedUsers = s.fo / 1000000;
-    TSol schedSol; // A copy of the solution to schedule. Else, a solution WITH charging stations could be passed on to next LS, causing issues
+    static thread_local TSol schedSol; // A copy of the solution to schedule. Else, a solution WITH charging stations could be passed on to next LS, causing issues
 
-    sort(s.vec.begin(), s.vec.begin() + nbUsers, sortByRkLS); // need to sort again, since at the end of decoding, rk's are sorted by user again
+    static thread_local std::vector <int> order;
+    ArgSortKeys(s.vec.data(), nbUsers, order); // same user order as the decoder
 
     // Iterate over all users that weren't inserted
     for (int i = nbUsers - nbUninsertedUsers; i < nbUsers; i++) { // For each user still not inserted. i is index of place within rk vector, NOT the user index itself
         // Try inserting in different routes
         for (int veh = 0; veh < s.sol.size(); veh++) { // For each route in which to try insertion
-            if (veh == floor(s.vec[i].rk * nbVehicles)) continue; // Skip route that was already tried
+            if (veh == floor(s.vec[order[i]] * nbVehicles)) continue; // Skip route that was already tried
             else {
                 // Try insertion
-                if (BestFeasibleInsertion(s.sol[veh], s.vec[i].user, nbUsers, dist, node)) {
+                if (BestFeasibleInsertion(s.sol[veh], order[i], problem)) {
                     s.fo -= 1000000; // One less infeasibility
                     break; // If feasible insertion found, stop searching for this user
                 }
@@ -466,38 +476,49 @@ TSol Insertion(TSol s, int n, std::vector <TNode>& node,
 
     // If all users are now inserted, apply scheduling & calculate objective value
     if (s.fo == 0) {
-        CalculateLoadCapacity(s, node);
-        schedSol = Scheduler(s, node, dist, vehicle, nbUsers, nbVehicles, periodLength, cStations, maxRideTimes, weights, elecPrices, cons);
-        s.fo = objFct(schedSol, node, dist, nbVehicles, nbUsers, periodLength, maxRideTimes, weights, elecPrices);
+        CalculateLoadCapacity(s, problem);
+        schedSol = s;
+        schedSol = Scheduler(std::move(schedSol), problem, &scheduleCache);
+        s.fo = objFct(schedSol, problem);
     }
 
-    sort(s.vec.begin(), s.vec.begin() + nbUsers, sortByUserLS); // To make parametric crossover work
-
     return s;
 }
 
 
-bool UpdateLTBackwards(std::vector<TVecSol>& route, int start, std::vector <std::vector <double> >& dist, std::vector <TNode>& node) {
+bool UpdateLTBackwards(TRoute& route, int start, const TProblem& problem) {
+    const std::vector <TNode>& node = problem.node;
+    const TMatrix& dist = problem.dist;
+
     // Updates LT "backwards" from start as long as needed & returns false if infeasibility is encountered.
 
-    for (int k = start; k >= 0; k--) {
-        for (int i = start; i > 0; i--) {
-            route[i].LT = std::min(node[route[i].stop].dep, route[i + 1].LT - node[route[i].stop].d - dist[route[i].stop][route[i + 1].stop]);
-            // Check if still feasible
-            if (route[i].ET > route[i].LT) {
-                // If not feasible, return false
-                return false;
-            }
+    const int* stop = route.stop;
+    const double* ET = route.ET;
+    double* LT = route.LT;
+
+    for (int i = start; i > 0; i--) {
+        LT[i] = std::min(node[stop[i]].dep, LT[i + 1] - node[stop[i]].d - dist[stop[i]][stop[i + 1]]);
+        // Check if still feasible
+        if (ET[i] > LT[i]) {
+            // If not feasible, return false
+            return false;
         }
     }
     return true; // If no infeasibility encountered, return TRUE
 }
 
-bool UpdateETForwards(std::vector<TVecSol>& route, int start, std::vector <std::vector <double> >& dist, std::vector <TNode>& node) {
+bool UpdateETForwards(TRoute& route, int start, const TProblem& problem) {
+    const std::vector <TNode>& node = problem.node;
+    const TMatrix& dist = problem.dist;
+
+    const int* stop = route.stop;
+    double* ET = route.ET;
+    const double* LT = route.LT;
+
     for (int i = start; i < route.size(); i++) {
-        route[i].ET = std::max(node[route[i].stop].arr, route[i - 1].ET + node[route[i - 1].stop].d + dist[route[i - 1].stop][route[i].stop]);
+        ET[i] = std::max(node[stop[i]].arr, ET[i - 1] + node[stop[i - 1]].d + dist[stop[i - 1]][stop[i]]);
         // Check if still feasible
-        if (route[i].ET > route[i].LT) {
+        if (ET[i] > LT[i]) {
             // If not feasible, return false
             return false;
         }
@@ -506,108 +527,78 @@ bool UpdateETForwards(std::vector<TVecSol>& route, int start, std::vector <std::
     return true;
 }
 
-int RemoveRequest(std::vector<TVecSol>& route, int position, int nbUsers, std::vector <std::vector <double> > &dist, std::vector <TNode> &node) {
+int RemoveRequest(TRoute& route, int position, const TProblem& problem) {
+    int nbUsers = problem.nbUsers;
+
     int requestID = route[position].stop;
     // Delete pick-up and drop-off from route
-    route.erase(route.begin() + position); // Delete pick - up
-    UpdateLTBackwards(route, position - 1, dist, node); // Update LT
-    UpdateETForwards(route, position, dist, node); // Update ET
+    route.erase(position); // Delete pick - up
+    UpdateLTBackwards(route, position - 1, problem); // Update LT
+    UpdateETForwards(route, position, problem); // Update ET
     // Find and delete drop-off
     for (int j = position; j < route.size() - 1; j++) { // Start searching AT position where (deleted) pick-up WAS, since now the next element is at that position
         if (route[j].stop == requestID + nbUsers) { // If this is the drop-off you're searching for
-            route.erase(route.begin() + j); // Delete drop-off
-            UpdateLTBackwards(route, j - 1, dist, node); // Update LT
-            UpdateETForwards(route, j, dist, node); // Update ET
+            route.erase(j); // Delete drop-off
+            UpdateLTBackwards(route, j - 1, problem); // Update LT
+            UpdateETForwards(route, j, problem); // Update ET
             break; // Stop looking further
         }
     }
     return requestID;
 }
 
-bool BestFeasibleInsertion(std::vector<TVecSol>& route, int user, int nbUsers, std::vector <std::vector <double> > &dist, std::vector <TNode> &node) {
+bool BestFeasibleInsertion(TRoute& route, int user, const TProblem& problem) {
+    const TArcSet& forbiddenArcs = problem.forbiddenArcs;
+    int nbUsers = problem.nbUsers;
+
     int bestInsert = 0;
     int j;
     float costBest;
     float costInsertion = 0;
-    TVecSol precStop;
-    TVecSol tempStop{};
-    std::vector <TVecSol> tempRoute;
-    std::vector <TVecSol> bestRoute = route;
-    std::vector <TVecSol> backUp = route;
-    bool feasible = true;
+    static thread_local TInsertionCosts costs;
+    static thread_local TRoute backUp;
+    backUp = route;
+    bool inserted = false;
+
+    // Load and time-window state of the route, to test insertions without copying the route (origin depot LT is left as is)
+    static thread_local TRouteTiming timing;
+    timing.first = 1;
+    timing.Build(route, problem);
 
     for (int nodeID : {user, nbUsers + user}) { // Once for pick-up node, once for drop-off node
         costBest = INFINITO;
+        inserted = false;
         // Determine cheapest feasible insertion
         // If drop-off node, start searching where you just inserted the pick-up. Else (if pick-up), start search at first position.
         j = bestInsert + 1; // If pick-up node, j will = 1. If drop-off, j will = location of pick-up +1.
 
-        while (j < route.size()) { // For all possible insertion positions. +1 for dropoff nodes, because pickup was just inserted in bestRoute (but not in route yet)
-            feasible = true;
-            if (node[nodeID].arr < route[j].LT - dist[nodeID][route[j].stop] - node[nodeID].d) { // If soonest time of node you want to insert is earlier than latest time of node that would be visited next if inserted (- travel time & service time). In the other case, insertion will be infeasible anyway.
-                precStop = route[j - 1];
-                // Check if cheapest
-                costInsertion = dist[precStop.stop][nodeID] + dist[nodeID][route[j].stop] - dist[precStop.stop][route[j].stop];
-                // Only check feasibility if cheapest.
-                if (costInsertion < costBest) {
-                    // Create a temporary route                  
-                    tempRoute = route;
-                    tempStop.stop = nodeID;
-                    tempRoute.insert(tempRoute.begin() + j, tempStop); // Insert the stop into the temporary route
-                    // Update capacity and check feasibility
-                    for (int k = j; k < tempRoute.size(); k++) {
-                        tempRoute[k].C = tempRoute[k - 1].C - node[tempRoute[k].stop].l;
-                        if (tempRoute[k].C < 0) {
-                            feasible = false;
-                            break;
-                        }
-                    }
-                    // If not load-feasible, go to next insertion
-                    if (!feasible) {
-                        j++;
-                        continue;
-                    }
-                    // Update earliest start-time
-                    tempRoute[j].ET = std::max(tempRoute[j - 1].ET + node[tempRoute[j - 1].stop].d + dist[tempRoute[j - 1].stop][tempRoute[j].stop], node[tempRoute[j].stop].arr);
-                    // Update latest start-time
-                    tempRoute[j].LT = std::min(tempRoute[j + 1].LT - node[tempRoute[j].stop].d - dist[tempRoute[j].stop][tempRoute[j + 1].stop], node[tempRoute[j].stop].dep);
-                    // If tightened window indicates infeasible, set to infeasibility
-                    if (tempRoute[j].LT < tempRoute[j].ET) {
-                        feasible = false;
-                    }
-                    else {
-                        // If tightened window does not indicate infeasibility, update ET and LT of other stops and check feasibility again
-                        // Update LT "backwards" as long as needed
-                        feasible = UpdateLTBackwards(tempRoute, j - 1, dist, node);
-                        // IF STILL FEASIBLE, update ET "forwards" as long as needed
-                        if (feasible) {
-                            feasible = UpdateETForwards(tempRoute, j + 1, dist, node);
-                        }
-                    }
-                    // If temporary route is feasible, copy to best route and set best cost to the cost of this insertion                   
-                    if (feasible) {
-                        bestRoute = tempRoute;
-                        costBest = costInsertion;
-                        bestInsert = j;
-                    }
-                }
+        costs.Compute(route, nodeID, j, route.size(), forbiddenArcs, true, problem);
+        while (j < route.size()) { // For all possible insertion positions (for the drop-off the pick-up is already in route)
+            // Only check feasibility if cheapest (an insertion ruled out by an eliminated arc or by the time windows costs INFINITY). If load and time windows allow it, remember this insertion
+            costInsertion = costs[j];
+            if (costInsertion < costBest && timing.LoadFeasible(route, j, nodeID, problem) && timing.TimeFeasible(route, j, nodeID, problem)) {
+                costBest = costInsertion;
+                bestInsert = j;
+                inserted = true;
             }
             j++;
         }
         // Check feasibility of this assignment of requests to vehicles
-        if (route.size() == bestRoute.size()) { // If pick-up, this tests whether bestRoute is as big as original route. If drop-off, this tests whether bestRoute is as big as original route - 1 for already inserted pickup.
-            // If best route found is as long as current route, no feasible insertion was found.
+        if (!inserted) {
+            // If no feasible insertion was found, restore the route (the pick-up may be inserted already)
             route = backUp;
             return false;
         }
-        // If feasibly inserted, copy to route
-        route = bestRoute;
+        // If feasibly inserted, apply the insertion to route
+        timing.Insert(route, bestInsert, nodeID, problem);
     }
     // If pickup AND dropoff feasibly inserted return true
     return true;
 }
 
-void CalculateLoadCapacity(TSol& s, std::vector <TNode>& node) {
+void CalculateLoadCapacity(TSol& s, const TProblem& problem) {
+    const std::vector <TNode>& node = problem.node;
+
     for (int v = 0; v < s.sol.size(); v++) {
         for (int i = 1; i < s.sol[v].size()-1; i++) {
             s.sol[v][i].C = s.sol[v][i - 1].C - node[s.sol[v][i].stop].l;
@@ -617,7 +608,7 @@ void CalculateLoadCapacity(TSol& s, std::vector <TNode>& node) {
 
 double rand(double min, double max)
 {
-	return ((double)(rand()%10000)/10000.0)*(max-min)+min;
+	return ((double)(ThreadRand()%10000)/10000.0)*(max-min)+min;
     //return uniform_real_distribution<double>(min, max)(rng);
 }
 
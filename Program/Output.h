@@ -9,8 +9,13 @@
 #include "Data.h"
 #include "Read.h"
 
-void WriteSolutionScreen(TSol s, int n, float timeBest, float timeTotal, char instance[], int nbVehicles)
+void WriteSolutionScreen(const TSol& s, int n, float timeBest, float timeTotal, char instance[], const TProblem& problem)
 {
+	const std::vector <TNode>& node = problem.node;
+	const std::vector <int>& maxRideTimes = problem.maxRideTimes;
+	int nbUsers = problem.nbUsers;
+	int nbVehicles = problem.nbVehicles;
+
 	printf("\n\n\n Instance: %s \nsol: ", instance);
 	for (int i = 0; i < nbVehicles; i++) {
 		printf("Vehicle %d\n", i + 1);
@@ -26,9 +31,9 @@ void WriteSolutionScreen(TSol s, int n, float timeBest, float timeTotal, char in
 		}
 	}
 	printf("\nLocal search applied: %d", s.flag);
-	printf("\nDecoder: %.2lf", s.vec[n].rk);
-	printf("\nScheduler: %.2lf", s.vec[n - 1].rk);
-	printf("\nCharging priority: %.2lf", s.vec[n - 2].rk);
+	printf("\nDecoder: %.2lf", s.vec[n]);
+	printf("\nScheduler: %.2lf", s.vec[n - 1]);
+	printf("\nCharging priority: %.2lf", s.vec[n - 2]);
 	printf("\nfo: %.5lf",s.fo);
 	printf("\nTotal time: %.3f",timeTotal);
 	printf("\nBest time: %.3f\n\n",timeBest);
@@ -36,8 +41,13 @@ void WriteSolutionScreen(TSol s, int n, float timeBest, float timeTotal, char in
     //printf("\nH1: %d (%d) H2: %d (%d) H3: %d (%d) H4: %d (%d)\n\n", H1, SH1, H2, SH2, H3, SH3, H4, SH4);
 }
 
-void WriteSolution(TSol s, int n, float timeBest, float timeTotal, char instance[])
+void WriteSolution(const TSol& s, int n, float timeBest, float timeTotal, char instance[], const TProblem& problem)
 {
+	const std::vector <TNode>& node = problem.node;
+	const std::vector <int>& maxRideTimes = problem.maxRideTimes;
+	int nbUsers = problem.nbUsers;
+	int nbVehicles = problem.nbVehicles;
+
 	FILE *arquivo;
     	arquivo = fopen("Results/Solutions.txt","a");
 
@@ -63,9 +73,9 @@ void WriteSolution(TSol s, int n, float timeBest, float timeTotal, char instance
 		}
 	}
 	fprintf(arquivo, "\nLocal search applied: %d", s.flag);
-	fprintf(arquivo, "\nDecoder: %.2lf", s.vec[n].rk);
-	fprintf(arquivo, "\nScheduler: %.2lf", s.vec[n - 1].rk);
-	fprintf(arquivo, "\nCharging priority: %.2lf", s.vec[n - 2].rk);
+	fprintf(arquivo, "\nDecoder: %.2lf", s.vec[n]);
+	fprintf(arquivo, "\nScheduler: %.2lf", s.vec[n - 1]);
+	fprintf(arquivo, "\nCharging priority: %.2lf", s.vec[n - 2]);
 	fprintf(arquivo, "\nfo: %.5lf", s.fo);
 	fprintf(arquivo, "\nTotal time: %.3f", timeTotal);
 	fprintf(arquivo, "\nBest time: %.3f\n\n", timeBest);
@@ -4,32 +4,93 @@
 #include <iomanip>
 #include <iostream>
 
-void ReadData(char nameTable[], int& n, std::vector <TNode>& node,
-    std::vector <std::vector <double> >& dist, std::vector <TVhcl>& vehicle,
-    int& nbVehicles, int& nbUsers, int& periodLength, int& H, std::vector <int>& oDepotIDs, std::vector <int>& fDepotIDs,
-    std::vector <TCstat>& cStations, std::vector <int>& maxRideTimes, double(&weights)[3], std::vector <double>& elecPrices, std::vector <std::vector <double> >& cons)
+static std::shared_ptr <const void> MapFile(const char name[], size_t& size);
+
+/************************************************************************************
+ Method: DetectFormat
+ Description: tells the Cordeau ('a') and Uber ('u') layouts apart from the header.
+ Both start with the same 8 integers; the Cordeau layout has 2*nbVehicles artificial
+ depot IDs, the Uber layout nbVehicles origin and 5 destination depot IDs and a full
+ travel-time matrix, so the expected number of tokens differs. Stops with an error
+ when the token count matches neither layout.
+*************************************************************************************/
+static char DetectFormat(const TTokenizer& in, const char name[])
 {
-    switch (nameTable[12]) {
-    case 'a':
-        ReadDataCordeau(nameTable, n, node, dist, vehicle, nbVehicles, nbUsers, periodLength, H, oDepotIDs, fDepotIDs, cStations, maxRideTimes, weights, elecPrices, cons);
-        break;
-    case 'u':
-        ReadDataUber(nameTable, n, node, dist, vehicle, nbVehicles, nbUsers, periodLength, H, oDepotIDs, fDepotIDs, cStations, maxRideTimes, weights, elecPrices, cons);
-        break;
-    }
+    TTokenizer head = in;
+    long long total = head.countTokens();
+    if (total < 8) head.fail();
+    long long nbVehicles = head.nextInt(), nbUsers = head.nextInt(), nbODepots = head.nextInt(), nbFDepots = head.nextInt();
+    long long nbCStations = head.nextInt(), nbRep = head.nextInt(), periodLength = head.nextInt(), H = head.nextInt();
+    (void)nbRep;
+    if (periodLength <= 0) head.fail();
+
+    long long nbPeriods = (long long)ceil((float)H / periodLength);
+    long long common = 8 + nbODepots + nbFDepots + nbCStations + nbUsers + 4 * nbVehicles + nbCStations + 1 + 3 + nbCStations + nbPeriods;
+    long long nCordeau = 2 * nbUsers + 2 * nbVehicles + nbCStations + 2;
+    long long nUber = 2 * nbUsers + nbVehicles + 5 + nbCStations + 2;
+
+    if (total == common + 2 * nbVehicles + 7 * nCordeau) return 'a';
+    if (total == common + nbVehicles + 5 + 7 * nUber + nUber * nUber) return 'u';
+
+    printf("\nERROR: File (%s) matches neither the Cordeau nor the Uber layout!\n", name);
+    getchar();
+    exit(1);
+}
 
-    // Time-window tightening
-    for (int i = 0; i < nbUsers; i++) {
-        node[i].arr = std::max(node[i].arr, node[i + nbUsers].arr - maxRideTimes[i] - node[i].d);
-        node[i].dep = std::min(node[i].dep, node[i + nbUsers].dep - dist[i][i + nbUsers] - node[i].d);
-    }
-    for (int i = nbUsers; i < 2 * nbUsers; i++) {
-        node[i].arr = std::max(node[i].arr, node[i - nbUsers].arr + dist[i - nbUsers][i] + node[i - nbUsers].d);
-        node[i].dep = std::min(node[i].dep, node[i - nbUsers].dep + node[i - nbUsers].d + maxRideTimes[i - nbUsers]);
+void ReadData(char nameTable[], int& n, TProblem& problem)
+{
+    std::vector <TNode>& node = problem.node;
+    TMatrix& dist = problem.dist;
+    std::vector <int>& maxRideTimes = problem.maxRideTimes;
+
+    char name[200] = "Instances";
+    strcat(name, nameTable);
+    char cacheName[210];
+    sprintf(cacheName, "%s.bin", name);
+
+    // Load the precompiled binary copy of the instance if it is still up to date, else parse the text file and (re)write the copy
+    if (!ReadCache(name, cacheName, n, problem)) {
+        size_t size = 0;
+        std::shared_ptr <const void> text = MapFile(name, size);
+        if (!text)
+        {
+            printf("\nERROR: File (%s) not found!\n", name);
+            getchar();
+            exit(1);
+        }
+        TTokenizer in((const char*)text.get(), (const char*)text.get() + size);
+
+        switch (DetectFormat(in, name)) {
+        case 'a':
+            ReadDataCordeau(in, n, problem);
+            break;
+        case 'u':
+            ReadDataUber(in, n, problem);
+            break;
+        }
+        int nbUsers = problem.nbUsers;
+
+        // Time-window tightening
+        for (int i = 0; i < nbUsers; i++) {
+            node[i].arr = std::max(node[i].arr, node[i + nbUsers].arr - maxRideTimes[i] - node[i].d);
+            node[i].dep = std::min(node[i].dep, node[i + nbUsers].dep - dist[i][i + nbUsers] - node[i].d);
+        }
+        for (int i = nbUsers; i < 2 * nbUsers; i++) {
+            node[i].arr = std::max(node[i].arr, node[i - nbUsers].arr + dist[i - nbUsers][i] + node[i - nbUsers].d);
+            node[i].dep = std::min(node[i].dep, node[i - nbUsers].dep + node[i - nbUsers].d + maxRideTimes[i - nbUsers]);
+        }
+
+        WriteCache(name, cacheName, n, problem);
     }
 
     // Arc deletion
-    // TO BE SEEN
+    EliminateArcs(problem);
+
+    // Charging station detours
+    BuildStationTable(problem);
+
+    // Charging costs
+    BuildPriceTable(problem);
 
     // TEST
     
@@ -94,23 +155,21 @@ void ReadData(char nameTable[], int& n, std::vector <TNode>& node,
     printf("\n");*/
 }
 
-void ReadDataCordeau(char nameTable[], int& n, std::vector <TNode>& node,
-    std::vector <std::vector <double> >& dist, std::vector <TVhcl>& vehicle,
-    int& nbVehicles, int& nbUsers, int& periodLength, int& H, std::vector <int>& oDepotIDs, std::vector <int>& fDepotIDs,
-    std::vector <TCstat>& cStations, std::vector <int>& maxRideTimes, double(&weights)[3], std::vector <double>& elecPrices, std::vector <std::vector <double> >& cons)
+void ReadDataCordeau(TTokenizer& in, int& n, TProblem& problem)
 {
-    char name[200] = "Instances";
-    strcat(name, nameTable);
-
-    FILE* arq;
-    arq = fopen(name, "r");
-
-    if (arq == NULL)
-    {
-        printf("\nERROR: File (%s) not found!\n", name);
-        getchar();
-        exit(1);
-    }
+    std::vector <TNode>& node = problem.node;
+    TMatrix& dist = problem.dist;
+    std::vector <TVhcl>& vehicle = problem.vehicle;
+    int& nbVehicles = problem.nbVehicles;
+    int& nbUsers = problem.nbUsers;
+    int& periodLength = problem.periodLength;
+    int& H = problem.H;
+    std::vector <int>& oDepotIDs = problem.oDepotIDs;
+    std::vector <int>& fDepotIDs = problem.fDepotIDs;
+    std::vector <TCstat>& cStations = problem.cStations;
+    std::vector <int>& maxRideTimes = problem.maxRideTimes;
+    double(&weights)[3] = problem.weights;
+    std::vector <double>& elecPrices = problem.elecPrices;
 
     // => read data
 
@@ -118,8 +177,14 @@ void ReadDataCordeau(char nameTable[], int& n, std::vector <TNode>& node,
     int nbODepots;
     int nbFDepots;
     int nbCStations;
-    int nbRep; // Irrelevant number
-    fscanf(arq, "%d %d %d %d %d %d %d %d", &nbVehicles, &nbUsers, &nbODepots, &nbFDepots, &nbCStations, &nbRep, &periodLength, &H);
+    nbVehicles = in.nextInt();
+    nbUsers = in.nextInt();
+    nbODepots = in.nextInt();
+    nbFDepots = in.nextInt();
+    nbCStations = in.nextInt();
+    in.nextInt(); // Irrelevant number
+    periodLength = in.nextInt();
+    H = in.nextInt();
 
     // read node informations
     int nAux = 2 * nbUsers + 2 * nbVehicles + nbCStations + 2; // !!!!! NOT GENERALISABLE; BASED ON CORDEAU INSTANCES ONLY
@@ -128,46 +193,51 @@ void ReadDataCordeau(char nameTable[], int& n, std::vector <TNode>& node,
 
     for (int i = 0; i < nAux; i++)
     {
-        fscanf(arq, "%d %lf %lf %f %d %lf %lf", &nodeTemp.id, &nodeTemp.x, &nodeTemp.y, &nodeTemp.d, &nodeTemp.l, &nodeTemp.arr, &nodeTemp.dep);
+        nodeTemp.id = in.nextInt();
+        nodeTemp.x = in.nextDouble();
+        nodeTemp.y = in.nextDouble();
+        nodeTemp.d = in.nextFloat();
+        nodeTemp.l = in.nextInt();
+        nodeTemp.arr = in.nextDouble();
+        nodeTemp.dep = in.nextDouble();
         node.push_back(nodeTemp);
     }
 
     // read common origin depot id
-    int trash;
     for (int i = 0; i < nbODepots; i++) {
-        fscanf(arq, "%d", &trash); // Useless ID's, only artificial depots are used
+        in.nextInt(); // Useless ID's, only artificial depots are used
     }
 
     // read common destination depot id
     for (int i = 0; i < nbFDepots; i++) {
-        fscanf(arq, "%d", &trash); // Useless ID's, only artificial depots are used
+        in.nextInt(); // Useless ID's, only artificial depots are used
     }
 
     // read (artificial) origin depots id
     int id_temp = -1;
     for (int i = 0; i < nbVehicles; i++) {
-        fscanf(arq, "%d", &id_temp);
+        id_temp = in.nextInt();
         oDepotIDs.push_back(id_temp);
     }
 
     // read (artificial) destination depots id
     id_temp = -1;
     for (int i = 0; i < nbVehicles; i++) {
-        fscanf(arq, "%d", &id_temp);
+        id_temp = in.nextInt();
         fDepotIDs.push_back(id_temp);
     }
 
     // read charging stations id
     TCstat CS_temp;
     for (int i = 0; i < nbCStations; i++) {
-        fscanf(arq, "%d", &CS_temp.id);
+        CS_temp.id = in.nextInt();
         cStations.push_back(CS_temp); // Charging station with only ID is pushed. Alpha and cap are read/written later.
     }
 
     // read users maximum ride time
     int tempRT;
     for (int i = 0; i < nbUsers; i++) {
-        fscanf(arq, "%d", &tempRT);
+        tempRT = in.nextInt();
         maxRideTimes.push_back(tempRT);
     }
 
@@ -180,55 +250,54 @@ void ReadDataCordeau(char nameTable[], int& n, std::vector <TNode>& node,
 
     // read vehicles capacity
     for (int i = 0; i < nbVehicles; i++) {
-        fscanf(arq, "%d", &vehicle[i].C);
+        vehicle[i].C = in.nextInt();
     }
 
     // read vehicles initial battery inventory
     for (int i = 0; i < nbVehicles; i++) {
-        fscanf(arq, "%lf", &vehicle[i].B0);
+        vehicle[i].B0 = in.nextDouble();
     }
 
     // read vehicles battery capacities
     for (int i = 0; i < nbVehicles; i++) {
-        fscanf(arq, "%lf", &vehicle[i].Q);
+        vehicle[i].Q = in.nextDouble();
     }
 
     // read minimum end battery ratio levels
     for (int i = 0; i < nbVehicles; i++) {
-        fscanf(arq, "%lf", &vehicle[i].r);
+        vehicle[i].r = in.nextDouble();
     }
 
     // read recharging rates at charging stations
     for (int i = 0; i < nbCStations; i++) {
-        fscanf(arq, "%lf", &cStations[i].alpha);
+        cStations[i].alpha = in.nextDouble();
     }
 
     // read vehicles discharging rate
-    double dischRate;
-    fscanf(arq, "%lf", &dischRate);
+    problem.dischRate = in.nextDouble();
 
     // read weight factors
-    fscanf(arq, "%lf %lf %lf", &weights[0], &weights[1], &weights[2]);
+    weights[0] = in.nextDouble();
+    weights[1] = in.nextDouble();
+    weights[2] = in.nextDouble();
 
     // read capacities of the charging stations
     for (int i = 0; i < nbCStations; i++) {
-        fscanf(arq, "%int", &cStations[i].cap);
+        cStations[i].cap = in.nextInt();
     }
 
     // read period electricity prices
     int nbPeriods = ceil((float)H / periodLength);
     double tempP;
     for (int i = 0; i < nbPeriods; i++) {
-        fscanf(arq, "%lf", &tempP);
+        tempP = in.nextDouble();
         tempP = std::max(0.0, tempP);
         elecPrices.push_back(tempP);
     }
 
-    fclose(arq);
-
     // calculate the euclidean distance
     dist.clear();
-    dist.resize(nAux, std::vector<double>(nAux));
+    dist.resize(nAux, nAux);
 
     for (int i = 0; i < nAux; i++)
     {
@@ -239,38 +308,24 @@ void ReadDataCordeau(char nameTable[], int& n, std::vector <TNode>& node,
     }
 
 
-    // Calculate the battery consumption
-    cons.clear();
-    cons.resize(nAux, std::vector<double>(nAux));
-
-    for (int i = 0; i < nAux; i++)
-    {
-        for (int j = i; j < nAux; j++)
-        {
-            cons[i][j] = cons[j][i] = dischRate * dist[i][j];
-        }
-    }
-
     n = 2* nbUsers + nbVehicles + 2; // Chromosome length. 1 per pickup, 1 per dropoff, 1 for scheduler, 1 for CP, Should exclude chromosome for decoder.
 } 
 
-void ReadDataUber(char nameTable[], int& n, std::vector <TNode>& node,
-    std::vector <std::vector <double> >& dist, std::vector <TVhcl>& vehicle,
-    int& nbVehicles, int& nbUsers, int& periodLength, int& H, std::vector <int>& oDepotIDs, std::vector <int>& fDepotIDs,
-    std::vector <TCstat>& cStations, std::vector <int>& maxRideTimes, double(&weights)[3], std::vector <double>& elecPrices, std::vector <std::vector <double> >& cons)
+void ReadDataUber(TTokenizer& in, int& n, TProblem& problem)
 {
-    char name[200] = "Instances";
-    strcat(name, nameTable);
-
-    FILE* arq;
-    arq = fopen(name, "r");
-
-    if (arq == NULL)
-    {
-        printf("\nERROR: File (%s) not found!\n", name);
-        getchar();
-        exit(1);
-    }
+    std::vector <TNode>& node = problem.node;
+    TMatrix& dist = problem.dist;
+    std::vector <TVhcl>& vehicle = problem.vehicle;
+    int& nbVehicles = problem.nbVehicles;
+    int& nbUsers = problem.nbUsers;
+    int& periodLength = problem.periodLength;
+    int& H = problem.H;
+    std::vector <int>& oDepotIDs = problem.oDepotIDs;
+    std::vector <int>& fDepotIDs = problem.fDepotIDs;
+    std::vector <TCstat>& cStations = problem.cStations;
+    std::vector <int>& maxRideTimes = problem.maxRideTimes;
+    double(&weights)[3] = problem.weights;
+    std::vector <double>& elecPrices = problem.elecPrices;
 
     // => read data
 
@@ -278,8 +333,14 @@ void ReadDataUber(char nameTable[], int& n, std::vector <TNode>& node,
     int nbODepots;
     int nbFDepots;
     int nbCStations;
-    int nbRep; // Irrelevant number
-    fscanf(arq, "%d %d %d %d %d %d %d %d", &nbVehicles, &nbUsers, &nbODepots, &nbFDepots, &nbCStations, &nbRep, &periodLength, &H);
+    nbVehicles = in.nextInt();
+    nbUsers = in.nextInt();
+    nbODepots = in.nextInt();
+    nbFDepots = in.nextInt();
+    nbCStations = in.nextInt();
+    in.nextInt(); // Irrelevant number
+    periodLength = in.nextInt();
+    H = in.nextInt();
 
     // read node informations
     int nAux = 2 * nbUsers + nbVehicles + 5 + nbCStations + 2; // Nbvehicles duplicates of origin depot & 5 duplicates of final depot
@@ -289,47 +350,52 @@ void ReadDataUber(char nameTable[], int& n, std::vector <TNode>& node,
 
     for (int i = 0; i < nAux; i++)
     {
-        fscanf(arq, "%d %lf %lf %f %f %lf %lf", &nodeTemp.id, &nodeTemp.x, &nodeTemp.y, &nodeTemp.d, &auxL, &nodeTemp.arr, &nodeTemp.dep);
+        nodeTemp.id = in.nextInt();
+        nodeTemp.x = in.nextDouble();
+        nodeTemp.y = in.nextDouble();
+        nodeTemp.d = in.nextFloat();
+        auxL = in.nextFloat();
+        nodeTemp.arr = in.nextDouble();
+        nodeTemp.dep = in.nextDouble();
         nodeTemp.l = (int)auxL;
         node.push_back(nodeTemp);
     }
 
     // read common origin depot id
-    int trash;
     for (int i = 0; i < nbODepots; i++) {
-        fscanf(arq, "%d", &trash); // Useless ID's, only artificial depots are used
+        in.nextInt(); // Useless ID's, only artificial depots are used
     }
 
     // read common destination depot id
     for (int i = 0; i < nbFDepots; i++) {
-        fscanf(arq, "%d", &trash); // Useless ID's, only artificial depots are used
+        in.nextInt(); // Useless ID's, only artificial depots are used
     }
 
     // read (artificial) origin depots id
     int id_temp = -1;
     for (int i = 0; i < nbVehicles; i++) {
-        fscanf(arq, "%d", &id_temp);
+        id_temp = in.nextInt();
         oDepotIDs.push_back(id_temp);
     }
 
     // read (artificial) destination depots id
     id_temp = -1;
     for (int i = 0; i < 5; i++) {
-        fscanf(arq, "%d", &id_temp);
+        id_temp = in.nextInt();
         fDepotIDs.push_back(id_temp);
     }
 
     // read charging stations id
     TCstat CS_temp;
     for (int i = 0; i < nbCStations; i++) {
-        fscanf(arq, "%d", &CS_temp.id);
+        CS_temp.id = in.nextInt();
         cStations.push_back(CS_temp); // Charging station with only ID is pushed. Alpha and cap are read/written later.
     }
 
     // read users maximum ride time
     int tempRT;
     for (int i = 0; i < nbUsers; i++) {
-        fscanf(arq, "%d", &tempRT);
+        tempRT = in.nextInt();
         maxRideTimes.push_back(tempRT);
     }
 
@@ -342,92 +408,402 @@ void ReadDataUber(char nameTable[], int& n, std::vector <TNode>& node,
 
     // read vehicles capacity
     for (int i = 0; i < nbVehicles; i++) {
-        fscanf(arq, "%d", &vehicle[i].C);
+        vehicle[i].C = in.nextInt();
     }
 
     // read vehicles initial battery inventory
     for (int i = 0; i < nbVehicles; i++) {
-        fscanf(arq, "%lf", &vehicle[i].B0);
+        vehicle[i].B0 = in.nextDouble();
     }
 
     // read vehicles battery capacities
     for (int i = 0; i < nbVehicles; i++) {
-        fscanf(arq, "%lf", &vehicle[i].Q);
+        vehicle[i].Q = in.nextDouble();
     }
 
     // read minimum end battery ratio levels
     for (int i = 0; i < nbVehicles; i++) {
-        fscanf(arq, "%lf", &vehicle[i].r);
+        vehicle[i].r = in.nextDouble();
     }
 
     // read recharging rates at charging stations
     for (int i = 0; i < nbCStations; i++) {
-        fscanf(arq, "%lf", &cStations[i].alpha);
+        cStations[i].alpha = in.nextDouble();
     }
 
     // read vehicles discharging rate
-    double dischRate;
-    fscanf(arq, "%lf", &dischRate);
+    problem.dischRate = in.nextDouble();
 
     // read weight factors
-    fscanf(arq, "%lf %lf %lf", &weights[0], &weights[1], &weights[2]);
+    weights[0] = in.nextDouble();
+    weights[1] = in.nextDouble();
+    weights[2] = in.nextDouble();
 
     // Read travel times
     dist.clear();
-    dist.resize(nAux, std::vector<double>(nAux));
+    dist.resize(nAux, nAux);
     double aux;
     for (int i = 0; i < nAux; i++)
     {
         for (int j = 0; j < nAux; j++)
         {
-            fscanf(arq, "%lf", &aux);
+            aux = in.nextDouble();
             dist[i][j] = 2*aux;
         }
     }
 
     // read capacities of the charging stations
     for (int i = 0; i < nbCStations; i++) {
-        fscanf(arq, "%int", &cStations[i].cap);
+        cStations[i].cap = in.nextInt();
     }
 
     // read period electricity prices
     int nbPeriods = ceil((float)H / periodLength);
     double tempP;
     for (int i = 0; i < nbPeriods; i++) {
-        fscanf(arq, "%lf", &tempP);
+        tempP = in.nextDouble();
         tempP = std::max(0.0, tempP);
         elecPrices.push_back(tempP);
     }
 
-    fclose(arq);
 
+    n = 2 * nbUsers + nbVehicles +2; // Chromosome length. 1 per pickup, 1 per dropoff, 1 for scheduler, 1 for CP, Should exclude chromosome for decoder.
+}
 
-    // Calculate the battery consumption
-    cons.clear();
-    cons.resize(nAux, std::vector<double>(nAux));
+/************************************************************************************
+ Method: EliminateArcs
+ Description: marks the arcs (i,j) that cannot be travelled in any feasible route,
+ following the usual DARP arc-elimination rules:
+  - time windows: serving i as early as possible still reaches j after its window
+  - precedence/pairing: drop-off of a user directly before its own pick-up, arcs into
+    an origin depot or out of a final depot, origin depot -> drop-off
+  - capacity: two users that would both be on board exceed the largest vehicle capacity
+ The insertion routines test these arcs on partial routes, so only rules that also hold
+ while a pick-up waits for its drop-off are used (no pick-up -> final depot rule).
+ lateArcs only gets the time-window rule, for where a drop-off is inserted before its
+ pick-up (InsertionDecoder with the drop-off first).
+ Ride times are not used: they are a soft constraint here (penalised in objFct) and the
+ path based rules need the triangle inequality, which the Uber travel times do not satisfy.
+*************************************************************************************/
+void EliminateArcs(TProblem& problem)
+{
+    const std::vector <TNode>& node = problem.node;
+    const TMatrix& dist = problem.dist;
+    int nbUsers = problem.nbUsers;
+    int nbNodes = node.size();
+    const double tolerance = 0.000001; // never forbid an arc that the insertion checks would accept because of rounding
+
+    TArcSet& forbidden = problem.forbiddenArcs;
+    TArcSet& late = problem.lateArcs;
+    forbidden.resize(nbNodes);
+    late.resize(nbNodes);
+
+    int maxC = 0;
+    for (const TVhcl& v : problem.vehicle) maxC = std::max(maxC, v.C);
+
+    for (int i = 0; i < nbNodes; i++) {
+        forbidden.set(i, i);
+        late.set(i, i);
+        for (int j = 0; j < nbNodes; j++) {
+            if (node[i].arr + node[i].d + dist[i][j] > node[j].dep + tolerance) {
+                forbidden.set(i, j);
+                late.set(i, j);
+            }
+        }
+    }
 
-    for (int i = 0; i < nAux; i++)
-    {
-        for (int j = 0; j < nAux; j++)
-        {
-            cons[i][j] = dischRate * dist[i][j];
+    for (int i = 0; i < nbUsers; i++) {
+        forbidden.set(nbUsers + i, i);
+        for (int j = 0; j < nbUsers; j++) {
+            if (i != j && node[i].l + node[j].l > maxC) {
+                forbidden.set(i, j);                        // pick-up -> pick-up
+                forbidden.set(i, nbUsers + j);              // pick-up -> other drop-off
+                forbidden.set(nbUsers + i, nbUsers + j);    // drop-off -> drop-off
+            }
         }
     }
 
-    n = 2 * nbUsers + nbVehicles +2; // Chromosome length. 1 per pickup, 1 per dropoff, 1 for scheduler, 1 for CP, Should exclude chromosome for decoder.
+    for (int o : problem.oDepotIDs) {
+        for (int k = 0; k < nbNodes; k++) forbidden.set(k, o - 1);
+        for (int i = 0; i < nbUsers; i++) forbidden.set(o - 1, nbUsers + i);
+    }
+    for (int f : problem.fDepotIDs) {
+        for (int k = 0; k < nbNodes; k++) forbidden.set(f - 1, k);
+    }
 }
 
-void FreeMemoryProblem(std::vector <TNode> &node, std::vector <std::vector <double> > &dist, std::vector <TVhcl> &vehicle, std::vector <int> &oDepotIDs, std::vector <int>&fDepotIDs,
-    std::vector <TCstat>&cStations, std::vector <int>&maxRideTimes, std::vector <double>&elecPrices, std::vector <std::vector <double> >&cons)
+/************************************************************************************
+ Method: CheckTriangleInequality
+ Description: sets problem.metric if no detour is shorter than the direct arc, i.e.
+ dist[i][j] <= dist[i][k] + dist[k][j] for all nodes (up to rounding).
+*************************************************************************************/
+void CheckTriangleInequality(TProblem& problem)
 {
-    //specific problem
-    dist.clear();
-    node.clear();
-    vehicle.clear();
-    oDepotIDs.clear();
-    fDepotIDs.clear();
-    cStations.clear();
-    maxRideTimes.clear();
-    elecPrices.clear();
-    cons.clear();
+    const TMatrix& dist = problem.dist;
+    int nbNodes = problem.node.size();
+    const double tolerance = 0.000001;
+
+    problem.metric = true;
+    for (int i = 0; i < nbNodes && problem.metric; i++) {
+        for (int k = 0; k < nbNodes && problem.metric; k++) {
+            for (int j = 0; j < nbNodes; j++) {
+                if (dist[i][j] > dist[i][k] + dist[k][j] + tolerance) {
+                    problem.metric = false;
+                    break;
+                }
+            }
+        }
+    }
+}
+
+/************************************************************************************
+ Method: BuildStationTable
+ Description: for every arc (i,j) sorts the charging stations by the detour
+ dist[i][s] + dist[s][j]. Consumption is dischRate * dist, so this is also the order
+ by detour energy. Stations reached through an eliminated arc are left out.
+ Ties keep the station order of the instance file.
+*************************************************************************************/
+void BuildStationTable(TProblem& problem)
+{
+    const TMatrix& dist = problem.dist;
+    const std::vector <TCstat>& cStations = problem.cStations;
+    const TArcSet& forbiddenArcs = problem.forbiddenArcs;
+    int nbNodes = problem.node.size();
+    int nbStations = cStations.size();
+
+    TStationTable& table = problem.closestStations;
+    table.nbNodes = nbNodes;
+    table.nbStations = nbStations;
+    table.order.assign((size_t)nbNodes * nbNodes * nbStations, TStationTable::noStation);
+
+    std::vector <uint16_t> candidates;
+    std::vector <double> detour(nbStations);
+    for (int i = 0; i < nbNodes; i++) {
+        for (int j = 0; j < nbNodes; j++) {
+            candidates.clear();
+            for (int s = 0; s < nbStations; s++) {
+                int cs = cStations[s].id - 1;
+                detour[s] = dist[i][cs] + dist[cs][j];
+                if (!forbiddenArcs.test(i, cs) && !forbiddenArcs.test(cs, j)) candidates.push_back(s);
+            }
+            std::stable_sort(candidates.begin(), candidates.end(), [&detour](uint16_t a, uint16_t b) { return detour[a] < detour[b]; });
+            std::copy(candidates.begin(), candidates.end(), table.order.begin() + ((size_t)i * nbNodes + j) * nbStations);
+        }
+    }
+}
+
+/************************************************************************************
+ Method: BuildPriceTable
+ Description: fills problem.prices with the electricity price of each period and the
+ cost of charging from time 0 to the start of each period.
+*************************************************************************************/
+void BuildPriceTable(TProblem& problem)
+{
+    const std::vector <double>& elecPrices = problem.elecPrices;
+    int periodLength = problem.periodLength;
+
+    TPriceTable& table = problem.prices;
+    table.periodLength = periodLength;
+    table.price = elecPrices;
+    table.cost.assign(elecPrices.size() + 1, 0);
+    for (int p = 0; p < elecPrices.size(); p++) {
+        table.cost[p + 1] = table.cost[p] + periodLength * elecPrices[p];
+    }
+}
+
+/************************************************************************************
+                            BINARY INSTANCE CACHE
+ Layout: TCacheHeader | nodes | vehicles | origin depots | final depots | stations |
+         max ride times | prices | padding to 64 bytes | distance matrix (padded rows)
+ The distance matrix is used in place from the mapping, so processes solving the same
+ instance share its pages. The cache is rebuilt when the version, the matrix precision
+ or the size/modification time of the text instance do not match.
+*************************************************************************************/
+
+static const char cacheMagic[4] = { 'C', 'C', 'E', 'A' };
+static const int cacheVersion = 1;
+
+struct TCacheHeader
+{
+    char magic[4];
+    int version;
+    int distSize;                   // sizeof(TDist) the cache was written with
+    int nodeSize;                   // sizeof(TNode), guards against layout changes
+    long long srcSize;              // size of the text instance
+    long long srcTime;              // modification time of the text instance
+    int n;                          // chromosome length
+    int nbVehicles, nbUsers, periodLength, H;
+    int nbNodes, nbODepots, nbFDepots, nbCStations, nbMaxRideTimes, nbPrices;
+    int stride;                     // row stride of the distance matrix
+    double dischRate;
+    double weights[3];
+    long long distOffset;           // byte offset of the distance matrix (multiple of 64)
+};
+
+static bool SourceStamp(const char name[], long long& size, long long& time)
+{
+    struct stat st;
+    if (stat(name, &st) != 0) return false;
+    size = (long long)st.st_size;
+    time = (long long)st.st_mtime;
+    return true;
+}
+
+// Maps (or, without mmap, loads) the whole file read-only. Returns an empty pointer on failure.
+static std::shared_ptr <const void> MapFile(const char name[], size_t& size)
+{
+#ifdef _WIN32
+    FILE* arq = fopen(name, "rb");
+    if (arq == NULL) return std::shared_ptr <const void>();
+    fseek(arq, 0, SEEK_END);
+    size = (size_t)ftell(arq);
+    fseek(arq, 0, SEEK_SET);
+    void* buffer = ::operator new(size, std::align_val_t(TAlignedAllocator<TDist>::alignment));
+    bool ok = fread(buffer, 1, size, arq) == size;
+    fclose(arq);
+    std::shared_ptr <const void> map(buffer, [](const void* p) { ::operator delete(const_cast<void*>(p), std::align_val_t(TAlignedAllocator<TDist>::alignment)); });
+    if (!ok) map.reset();
+    return map;
+#else
+    int fd = open(name, O_RDONLY);
+    if (fd < 0) return std::shared_ptr <const void>();
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) { close(fd); return std::shared_ptr <const void>(); }
+    size = (size_t)st.st_size;
+    void* addr = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) return std::shared_ptr <const void>();
+    size_t len = size;
+    return std::shared_ptr <const void>(addr, [len](const void* p) { munmap(const_cast<void*>(p), len); });
+#endif
+}
+
+template <class T>
+static void CopyArray(const char* map, size_t& offset, int count, std::vector <T>& v)
+{
+    v.resize(count);
+    if (count > 0) memcpy(v.data(), map + offset, count * sizeof(T));
+    offset += count * sizeof(T);
+}
+
+template <class T>
+static void WriteArray(FILE* arq, const std::vector <T>& v)
+{
+    if (!v.empty()) fwrite(v.data(), sizeof(T), v.size(), arq);
 }
+
+bool ReadCache(const char name[], const char cacheName[], int& n, TProblem& problem)
+{
+    long long srcSize, srcTime;
+    if (!SourceStamp(name, srcSize, srcTime)) return false;
+
+    size_t size = 0;
+    std::shared_ptr <const void> map = MapFile(cacheName, size);
+    if (!map || size < sizeof(TCacheHeader)) return false;
+
+    const char* bytes = static_cast<const char*>(map.get());
+    TCacheHeader head;
+    memcpy(&head, bytes, sizeof(TCacheHeader));
+    if (memcmp(head.magic, cacheMagic, 4) != 0 || head.version != cacheVersion || head.distSize != (int)sizeof(TDist) || head.nodeSize != (int)sizeof(TNode)
+        || head.srcSize != srcSize || head.srcTime != srcTime || head.stride != TMatrix::paddedStride(head.nbNodes)
+        || head.distOffset + (long long)head.nbNodes * head.stride * sizeof(TDist) > (long long)size) {
+        return false;
+    }
+
+    n = head.n;
+    problem.nbVehicles = head.nbVehicles;
+    problem.nbUsers = head.nbUsers;
+    problem.periodLength = head.periodLength;
+    problem.H = head.H;
+    problem.dischRate = head.dischRate;
+    for (int i = 0; i < 3; i++) problem.weights[i] = head.weights[i];
+
+    size_t offset = sizeof(TCacheHeader);
+    CopyArray(bytes, offset, head.nbNodes, problem.node);
+    CopyArray(bytes, offset, head.nbVehicles, problem.vehicle);
+    CopyArray(bytes, offset, head.nbODepots, problem.oDepotIDs);
+    CopyArray(bytes, offset, head.nbFDepots, problem.fDepotIDs);
+    CopyArray(bytes, offset, head.nbCStations, problem.cStations);
+    CopyArray(bytes, offset, head.nbMaxRideTimes, problem.maxRideTimes);
+    CopyArray(bytes, offset, head.nbPrices, problem.elecPrices);
+
+    problem.dist.attach(map, reinterpret_cast<const TDist*>(bytes + head.distOffset), head.nbNodes, head.stride);
+    return true;
+}
+
+void WriteCache(const char name[], const char cacheName[], int n, const TProblem& problem)
+{
+    TCacheHeader head;
+    memset(&head, 0, sizeof(TCacheHeader));
+    if (!SourceStamp(name, head.srcSize, head.srcTime)) return;
+
+    memcpy(head.magic, cacheMagic, 4);
+    head.version = cacheVersion;
+    head.distSize = sizeof(TDist);
+    head.nodeSize = sizeof(TNode);
+    head.n = n;
+    head.nbVehicles = problem.nbVehicles;
+    head.nbUsers = problem.nbUsers;
+    head.periodLength = problem.periodLength;
+    head.H = problem.H;
+    head.nbNodes = problem.node.size();
+    head.nbODepots = problem.oDepotIDs.size();
+    head.nbFDepots = problem.fDepotIDs.size();
+    head.nbCStations = problem.cStations.size();
+    head.nbMaxRideTimes = problem.maxRideTimes.size();
+    head.nbPrices = problem.elecPrices.size();
+    head.stride = problem.dist.stride;
+    head.dischRate = problem.dischRate;
+    for (int i = 0; i < 3; i++) head.weights[i] = problem.weights[i];
+
+    const long long alignment = TAlignedAllocator<TDist>::alignment;
+    long long offset = sizeof(TCacheHeader) + head.nbNodes * sizeof(TNode) + head.nbVehicles * sizeof(TVhcl) + (head.nbODepots + head.nbFDepots) * sizeof(int)
+        + head.nbCStations * sizeof(TCstat) + head.nbMaxRideTimes * sizeof(int) + head.nbPrices * sizeof(double);
+    head.distOffset = (offset + alignment - 1) / alignment * alignment;
+
+    // Write to a temporary file first, so concurrent solver processes never map a half-written cache
+    char tempName[230];
+    sprintf(tempName, "%s.%ld.tmp", cacheName, (long)getpid());
+    FILE* arq = fopen(tempName, "wb");
+    if (arq == NULL) return; // e.g. read-only instance directory: just run without cache
+
+    fwrite(&head, sizeof(TCacheHeader), 1, arq);
+    WriteArray(arq, problem.node);
+    WriteArray(arq, problem.vehicle);
+    WriteArray(arq, problem.oDepotIDs);
+    WriteArray(arq, problem.fDepotIDs);
+    WriteArray(arq, problem.cStations);
+    WriteArray(arq, problem.maxRideTimes);
+    WriteArray(arq, problem.elecPrices);
+    char zeros[64] = { 0 };
+    fwrite(zeros, 1, head.distOffset - offset, arq);
+    fwrite(problem.dist[0], sizeof(TDist), (size_t)head.nbNodes * head.stride, arq);
+    bool ok = !ferror(arq);
+    fclose(arq);
+
+#ifdef _WIN32
+    remove(cacheName); // rename() does not replace an existing file on Windows
+#endif
+    if (!ok || rename(tempName, cacheName) != 0) {
+        remove(tempName);
+    }
+}
+
+void FreeMemoryProblem(TProblem& problem)
+{
+    //specific problem
+    problem.dist.clear();
+    problem.node.clear();
+    problem.vehicle.clear();
+    problem.oDepotIDs.clear();
+    problem.fDepotIDs.clear();
+    problem.cStations.clear();
+    problem.maxRideTimes.clear();
+    problem.elecPrices.clear();
+    problem.forbiddenArcs.bits.clear();
+    problem.lateArcs.bits.clear();
+    problem.closestStations.order.clear();
+    problem.prices.price.clear();
+    problem.prices.cost.clear();
+    problem.metric = false;
+}
\ No newline at end of file
@@ -9,23 +9,107 @@
 #include <stdio.h>
 #include <string.h>
 #include <math.h>
+#include <memory>
+#include <charconv>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
 
-void ReadData(char nameTable[], int& n, std::vector <TNode>& node,
-    std::vector <std::vector <double> >& dist, std::vector <TVhcl>& vehicle,
-    int& nbVehicles, int& nbUsers, int& periodLength, int& H, std::vector <int>& oDepotIDs, std::vector <int>& fDepotIDs,
-    std::vector <TCstat>& cStations, std::vector <int>& maxRideTimes, double(&weights)[3], std::vector <double>& elecPrices, std::vector <std::vector <double> >& cons);
+/***********************************************************************************
+ Struct: TTokenizer
+ Description: whitespace separated number reader over an in-memory (mapped) instance
+ file. Numbers are converted with std::from_chars, without locale or format strings.
+************************************************************************************/
+struct TTokenizer
+{
+    const char* begin;                          // first character of the file
+    const char* pos;                            // next character to read
+    const char* end;                            // one past the last character of the file
 
-void ReadDataCordeau(char nameTable[], int& n, std::vector <TNode>& node,
-    std::vector <std::vector <double> >& dist, std::vector <TVhcl>& vehicle,
-    int& nbVehicles, int& nbUsers, int& periodLength, int& H, std::vector <int>& oDepotIDs, std::vector <int>& fDepotIDs,
-    std::vector <TCstat>& cStations, std::vector <int>& maxRideTimes, double(&weights)[3], std::vector <double>& elecPrices, std::vector <std::vector <double> >& cons);
+    TTokenizer(const char* first, const char* last) : begin(first), pos(first), end(last) {}
 
-void ReadDataUber(char nameTable[], int& n, std::vector <TNode>& node,
-    std::vector <std::vector <double> >& dist, std::vector <TVhcl>& vehicle,
-    int& nbVehicles, int& nbUsers, int& periodLength, int& H, std::vector <int>& oDepotIDs, std::vector <int>& fDepotIDs,
-    std::vector <TCstat>& cStations, std::vector <int>& maxRideTimes, double(&weights)[3], std::vector <double>& elecPrices, std::vector <std::vector <double> >& cons);
+    static bool isSpace(char c) { return c == ' ' || c == '\n' || c == '\r' || c == '\t' || c == '\v' || c == '\f'; }
 
-void FreeMemoryProblem(std::vector <TNode>& node, std::vector <std::vector <double> >& dist, std::vector <TVhcl>& vehicle, std::vector <int>& oDepotIDs, std::vector <int>& fDepotIDs,
-    std::vector <TCstat>& cStations, std::vector <int>& maxRideTimes, std::vector <double>& elecPrices, std::vector <std::vector <double> >& cons);
+    void skipSpace()
+    {
+        while (pos < end && isSpace(*pos)) pos++;
+    }
+
+    void fail()
+    {
+        printf("\nERROR: unexpected data in instance file at byte %ld!\n", (long)(pos - begin));
+        getchar();
+        exit(1);
+    }
+
+    template <class T>
+    T next()
+    {
+        skipSpace();
+        if (pos < end && *pos == '+') pos++;
+        T value{};
+        std::from_chars_result res = std::from_chars(pos, end, value);
+        if (res.ec != std::errc()) fail();
+        pos = res.ptr;
+        return value;
+    }
+
+    int nextInt()
+    {
+        const char* start = pos;
+        int value = next<int>();
+        // Integer fields written as decimals (e.g. "30.0") are truncated, like a cast would do
+        if (pos < end && (*pos == '.' || *pos == 'e' || *pos == 'E')) {
+            pos = start;
+            value = (int)next<double>();
+        }
+        return value;
+    }
+
+    double nextDouble() { return next<double>(); }
+
+    float nextFloat() { return next<float>(); }
+
+    // Number of tokens left, without consuming them
+    long long countTokens() const
+    {
+        long long count = 0;
+        const char* p = pos;
+        while (p < end) {
+            while (p < end && isSpace(*p)) p++;
+            if (p == end) break;
+            count++;
+            while (p < end && !isSpace(*p)) p++;
+        }
+        return count;
+    }
+};
+
+void ReadData(char nameTable[], int& n, TProblem& problem);
+
+void ReadDataCordeau(TTokenizer& in, int& n, TProblem& problem);
+
+void ReadDataUber(TTokenizer& in, int& n, TProblem& problem);
+
+void EliminateArcs(TProblem& problem);
+
+void CheckTriangleInequality(TProblem& problem);
+
+void BuildStationTable(TProblem& problem);
+
+void BuildPriceTable(TProblem& problem);
+
+bool ReadCache(const char name[], const char cacheName[], int& n, TProblem& problem);
+
+void WriteCache(const char name[], const char cacheName[], int n, const TProblem& problem);
+
+void FreeMemoryProblem(TProblem& problem);
 
 #endif
\ No newline at end of file
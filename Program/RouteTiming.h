@@ -0,0 +1,247 @@
+//#pragma once
+#ifndef _ROUTETIMING_H
+#define _ROUTETIMING_H
+
+#include <vector>
+#include <algorithm>
+#include <math.h>
+#include "Data.h"
+
+/************************************************************************************
+ Method: TightenLT
+ Description: Updates LT "backwards" from start down to first as long as needed (LT of stop k
+ must leave room for service, charging and travel to stop k+1). Returns false if a tightened
+ window closes (LT < ET); the propagation itself is not stopped by that.
+*************************************************************************************/
+inline bool TightenLT(TRoute& route, int start, int first, const TProblem& problem)
+{
+    const std::vector <TNode>& node = problem.node;
+    const TMatrix& dist = problem.dist;
+
+    const int* stop = route.stop;
+    const double* ET = route.ET;
+    const double* w = route.w;
+    double* LT = route.LT;
+
+    bool feasible = true;
+    for (int k = start; k >= first; k--) {
+        double newLT = LT[k + 1] - dist[stop[k]][stop[k + 1]] - node[stop[k]].d - w[k];
+        if (newLT < LT[k]) { // If LT needs to be updated
+            LT[k] = newLT;
+            if (LT[k] < ET[k]) feasible = false;
+        }
+        else break; // Else, you can stop backwards updating
+    }
+    return feasible;
+}
+
+/************************************************************************************
+ Method: TightenET
+ Description: Updates ET "forwards" from start as long as needed. Returns false if a tightened
+ window closes (LT < ET); the propagation itself is not stopped by that.
+*************************************************************************************/
+inline bool TightenET(TRoute& route, int start, const TProblem& problem)
+{
+    const std::vector <TNode>& node = problem.node;
+    const TMatrix& dist = problem.dist;
+
+    const int* stop = route.stop;
+    const double* LT = route.LT;
+    const double* w = route.w;
+    double* ET = route.ET;
+
+    bool feasible = true;
+    for (int k = start; k < (int)route.size(); k++) {
+        double newET = ET[k - 1] + dist[stop[k - 1]][stop[k]] + node[stop[k - 1]].d + w[k - 1];
+        if (newET > ET[k]) { // If ET needs to be updated
+            ET[k] = newET;
+            if (LT[k] < ET[k]) feasible = false;
+        }
+        else break; // Else, you can stop forwards updating
+    }
+    return feasible;
+}
+
+/************************************************************************************
+ Struct: TInsertionCosts
+ Description: extra travel time of inserting nodeID before position j of a route, INFINITY if
+ the insertion uses an arc of arcs or if nodeID cannot be served before the latest time of the
+ next stop (its LT if useLT, else the end of its time window). By default costs[j] evaluates
+ position j on demand, so the tests that fail early skip the distance lookups. Compile with
+ -DSIMD_INSERTION to compute the costs of all positions in [start,end) at once, in a
+ branch-free loop the compiler vectorizes (with -mavx2 or wider); this only pays off on long
+ routes. The route must not change between Compute and the last costs[j].
+*************************************************************************************/
+struct TInsertionCosts
+{
+    const TRoute* route = nullptr;
+    const TArcSet* arcs = nullptr;
+    const TProblem* problem = nullptr;
+    int nodeID = 0;
+    bool useLT = false;
+#ifdef SIMD_INSERTION
+    std::vector <float> cost;
+    std::vector <double> depTime;
+#endif
+
+    void Compute(const TRoute& r, int node, [[maybe_unused]] int start, [[maybe_unused]] int end, const TArcSet& a, bool lt, const TProblem& p)
+    {
+        route = &r;
+        arcs = &a;
+        problem = &p;
+        nodeID = node;
+        useLT = lt;
+#ifdef SIMD_INSERTION
+        const TMatrix& dist = p.dist;
+        const int* stop = r.stop;
+        const TDist* fromNode = dist[nodeID];
+        double arr = p.node[nodeID].arr;
+        float d = p.node[nodeID].d;
+
+        cost.resize(r.size());
+        const double* LT = r.LT;
+        if (!useLT) { // Latest time of the next stops as one array
+            depTime.resize(r.size());
+            for (int j = start; j < end; j++) depTime[j] = p.node[stop[j]].dep;
+            LT = depTime.data();
+        }
+
+        #pragma omp simd
+        for (int j = start; j < end; j++) {
+            const TDist* fromPrev = dist[stop[j - 1]];
+            int next = stop[j];
+            float c = fromPrev[nodeID] + fromNode[next] - fromPrev[next];
+            float reject = arr < LT[j] - fromNode[next] - d ? 0.0f : INFINITY;
+            cost[j] = c + reject;
+        }
+
+        for (int j = start; j < end; j++) {
+            if (cost[j] < INFINITY && (a.test(stop[j - 1], nodeID) || a.test(nodeID, stop[j]))) cost[j] = INFINITY;
+        }
+#endif
+    }
+
+    float operator[](int j) const
+    {
+#ifdef SIMD_INSERTION
+        return cost[j];
+#else
+        const std::vector <TNode>& node = problem->node;
+        const TMatrix& dist = problem->dist;
+        const int* stop = route->stop;
+
+        if (arcs->test(stop[j - 1], nodeID) || arcs->test(nodeID, stop[j])) return INFINITY; // Insertion uses an eliminated arc
+        double LT = useLT ? route->LT[j] : node[stop[j]].dep;
+        if (!(node[nodeID].arr < LT - dist[nodeID][stop[j]] - node[nodeID].d)) return INFINITY; // Soonest service of nodeID must precede the latest service of the next stop
+        return dist[stop[j - 1]][nodeID] + dist[nodeID][stop[j]] - dist[stop[j - 1]][stop[j]];
+#endif
+    }
+};
+
+/************************************************************************************
+ Struct: TRouteTiming
+ Description: load and time-window state of one route that answers "can this pick-up or
+ drop-off be inserted before position j?" in constant time, so the insertion loops no longer
+ copy the route for every candidate position.
+  - backSlack[k]: how much LT[k] can decrease before TightenLT closes a window in stops 0..k
+  - fwdSlack[k]:  how much ET[k] can increase before TightenET closes a window in stops k..end
+  - onBoard[k]:   sum of the load changes of stops 1..k, maxOnBoard[k] its maximum over k..end
+ Only the chosen insertion is applied to the route (Insert), which rebuilds the state.
+ first is the first stop whose LT is tightened (the local search keeps the origin depot at 1).
+************************************************************************************/
+struct TRouteTiming
+{
+    int first = 0;
+    std::vector <double> backSlack;
+    std::vector <double> fwdSlack;
+    std::vector <int> onBoard;
+    std::vector <int> maxOnBoard;
+
+    void Build(const TRoute& route, const TProblem& problem)
+    {
+        const std::vector <TNode>& node = problem.node;
+        const TMatrix& dist = problem.dist;
+
+        const int* stop = route.stop;
+        const double* ET = route.ET;
+        const double* LT = route.LT;
+        const double* w = route.w;
+        int size = route.size();
+
+        backSlack.resize(size);
+        fwdSlack.resize(size);
+        onBoard.resize(size);
+        maxOnBoard.resize(size);
+
+        backSlack[0] = first > 0 ? INFINITY : std::max(0.0, LT[0] - ET[0]);
+        onBoard[0] = 0;
+        for (int k = 1; k < size; k++) {
+            double gap = LT[k] - dist[stop[k - 1]][stop[k]] - node[stop[k - 1]].d - w[k - 1] - LT[k - 1]; // decrease of LT[k] that does not reach stop k-1
+            backSlack[k] = k < first ? INFINITY : std::max(0.0, std::min(LT[k] - ET[k], gap + backSlack[k - 1]));
+            onBoard[k] = onBoard[k - 1] + node[stop[k]].l;
+        }
+
+        fwdSlack[size - 1] = std::max(0.0, LT[size - 1] - ET[size - 1]);
+        maxOnBoard[size - 1] = onBoard[size - 1];
+        for (int k = size - 2; k >= 0; k--) {
+            double gap = ET[k + 1] - (ET[k] + dist[stop[k]][stop[k + 1]] + node[stop[k]].d + w[k]); // increase of ET[k] that does not reach stop k+1
+            fwdSlack[k] = std::max(0.0, std::min(LT[k] - ET[k], gap + fwdSlack[k + 1]));
+            maxOnBoard[k] = std::max(onBoard[k], maxOnBoard[k + 1]);
+        }
+    }
+
+    // Load capacity stays >= 0 from position j onwards if nodeID is inserted before position j
+    bool LoadFeasible(const TRoute& route, int j, int nodeID, const TProblem& problem) const
+    {
+        return route.C[j - 1] + onBoard[j - 1] - problem.node[nodeID].l >= maxOnBoard[j - 1];
+    }
+
+    // Time windows stay open if nodeID is inserted before position j
+    bool TimeFeasible(const TRoute& route, int j, int nodeID, const TProblem& problem) const
+    {
+        const std::vector <TNode>& node = problem.node;
+        const TMatrix& dist = problem.dist;
+
+        const int* stop = route.stop;
+        int prev = stop[j - 1];
+        int next = stop[j];
+
+        // Tightened window of the inserted stop
+        double ET = std::max(route.ET[j - 1] + node[prev].d + dist[prev][nodeID], node[nodeID].arr);
+        double LT = std::min(route.LT[j] - node[nodeID].d - dist[nodeID][next], node[nodeID].dep);
+        if (LT < ET) return false;
+
+        // Decrease of LT of the preceding stop and increase of ET of the next stop
+        double newLT = LT - dist[prev][nodeID] - node[prev].d - route.w[j - 1];
+        if (newLT < route.LT[j - 1] && route.LT[j - 1] - newLT > backSlack[j - 1]) return false;
+        double newET = ET + dist[nodeID][next] + node[nodeID].d;
+        if (newET > route.ET[j] && newET - route.ET[j] > fwdSlack[j]) return false;
+
+        return true;
+    }
+
+    // Inserts nodeID before position j, updates load, ET and LT, and rebuilds the state
+    void Insert(TRoute& route, int j, int nodeID, const TProblem& problem)
+    {
+        const std::vector <TNode>& node = problem.node;
+        const TMatrix& dist = problem.dist;
+
+        TVecSol tempStop{};
+        tempStop.stop = nodeID;
+        route.insert(j, tempStop);
+
+        const int* stop = route.stop;
+        int* C = route.C;
+        for (int k = j; k < (int)route.size(); k++) {
+            C[k] = C[k - 1] - node[stop[k]].l;
+        }
+        route.ET[j] = std::max(route.ET[j - 1] + node[stop[j - 1]].d + dist[stop[j - 1]][stop[j]], node[stop[j]].arr);
+        route.LT[j] = std::min(route.LT[j + 1] - node[stop[j]].d - dist[stop[j]][stop[j + 1]], node[stop[j]].dep);
+        TightenLT(route, j - 1, first, problem);
+        TightenET(route, j + 1, problem);
+
+        Build(route, problem);
+    }
+};
+
+#endif
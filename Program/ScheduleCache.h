@@ -0,0 +1,110 @@
+//#pragma once
+#ifndef _SCHEDULECACHE_H
+#define _SCHEDULECACHE_H
+
+#include <vector>
+#include <cstring>
+#include "Data.h"
+#include "ChargerCalendar.h"
+
+/************************************************************************************
+ Struct: TScheduleCache
+ Description: charging stations inserted by Scheduler() per vehicle, for callers that
+ schedule many solutions differing in one or two routes (the local search). An entry keeps
+ the route as it was given to Scheduler(), the route with its charging sessions and the
+ charger queries and reservations made for it. When the vehicle gets the same route again,
+ the recorded queries are replayed on the reservations of the vehicles before it: if they
+ all get the same answers, the charging decisions would be the same and the stored route is
+ used. The random keys of the scheduled solutions must not change between Reset() calls.
+*************************************************************************************/
+struct TScheduleCache
+{
+    static const int ways = 4;                  // routes kept per vehicle
+
+    struct TEntry
+    {
+        unsigned long long stamp = 0;           // last use, 0 if the entry is empty
+        unsigned long long epoch = 0;           // epoch in which the entry was stored
+        TRoute input;                           // route given to Scheduler()
+        TRoute output;                          // route with the charging sessions
+        int batteryInfeasible = 0;              // the route could not be charged enough
+        std::vector <TChargerCalendar::TEvent> events;
+    };
+
+    std::vector <TEntry> entries;               // nbVehicles x ways entries
+    unsigned long long epoch = 0;
+    unsigned long long clock = 0;
+    long long hits = 0;
+    long long misses = 0;
+
+    // Empties the cache (in O(1): old entries are ignored)
+    void Reset(int nbVehicles)
+    {
+        if ((int)entries.size() != nbVehicles * ways) entries.resize(nbVehicles * ways);
+        epoch++;
+    }
+
+    // Entry of vehicle v holding route, nullptr if there is none
+    TEntry* Find(int v, const TRoute& route)
+    {
+        TEntry* set = &entries[v * ways];
+        for (int w = 0; w < ways; w++) {
+            if (set[w].epoch == epoch && Same(set[w].input, route)) return &set[w];
+        }
+        return nullptr;
+    }
+
+    // Sets route v of s to the stored result if its charger queries still get the same answers
+    // on calendar (its reservations are then made)
+    bool Reuse(TSol& s, int v, TChargerCalendar& calendar)
+    {
+        TEntry* entry = Find(v, s.sol[v]);
+        if (entry == nullptr || !calendar.Replay(entry->events)) {
+            misses++;
+            return false;
+        }
+        entry->stamp = ++clock;
+        s.sol[v] = entry->output;
+        s.battery_infeasibles += entry->batteryInfeasible;
+        hits++;
+        return true;
+    }
+
+    // Entry to record the scheduling of route for vehicle v in (the least recently used one)
+    TEntry& Claim(int v, const TRoute& route)
+    {
+        TEntry* entry = Find(v, route);
+        if (entry == nullptr) {
+            TEntry* set = &entries[v * ways];
+            entry = &set[0];
+            for (int w = 0; w < ways; w++) {
+                if (set[w].epoch != epoch) {
+                    entry = &set[w];
+                    break;
+                }
+                if (set[w].stamp < entry->stamp) entry = &set[w];
+            }
+            entry->epoch = epoch;
+            entry->input = route;
+        }
+        entry->stamp = ++clock;
+        entry->events.clear();
+        return *entry;
+    }
+
+    // Same route as far as Scheduler() reads it (B is recomputed)
+    static bool Same(const TRoute& a, const TRoute& b)
+    {
+        std::size_t n = a.size();
+        return n == b.size()
+            && std::memcmp(a.stop, b.stop, n * sizeof(int)) == 0
+            && std::memcmp(a.ET, b.ET, n * sizeof(double)) == 0
+            && std::memcmp(a.LT, b.LT, n * sizeof(double)) == 0
+            && std::memcmp(a.C, b.C, n * sizeof(int)) == 0
+            && std::memcmp(a.w, b.w, n * sizeof(double)) == 0
+            && std::memcmp(a.T, b.T, n * sizeof(double)) == 0
+            && std::memcmp(a.c_station, b.c_station, n * sizeof(char)) == 0;
+    }
+};
+
+#endif
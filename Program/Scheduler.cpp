@@ -10,196 +10,61 @@ bool sortByRKsched(const ZL& lhs, const ZL& rhs) { return lhs.rk > rhs.rk; }
 // Sort Zeroloads by Window
 bool sortByWindow(const ZL& lhs, const ZL& rhs) { return lhs.window > rhs.window; }
 
+// Sets the battery levels of route i and fills poss with its zero-loads (in route order) if it needs charging; returns the charge needed
+static double FindZeroLoads(TSol& s, int i, const TProblem& problem, std::vector<ZL>& poss);
+
+// Orders the zero-loads as given by chargingPriority
+static void OrderZeroLoads(std::vector<ZL>& poss, int chargingPriority);
+
+// Inserts the charging sessions of route i after the zero-loads in poss, in their order; returns how many zero-loads were inspected
+static int ChargeZeroLoads(TSol& s, int i, std::vector<ZL>& poss, double tot_charg_needed, const TProblem& problem, TChargerCalendar& calendar);
+
 //Scheduling procedure based on Bongiovanni 2020
-TSol Scheduler(TSol s, std::vector <TNode>& node, std::vector <std::vector <double> >& dist, std::vector <TVhcl> vehicle, int nbUsers,
-    int nbVehicles, int periodLength, std::vector <TCstat> cStations, std::vector <int> maxRideTimes, double weights[3], std::vector <double> elecPrices, std::vector <std::vector <double> >& cons)
+TSol Scheduler(TSol s, const TProblem& problem, TScheduleCache* cache)
 {
+    const std::vector <TCstat>& cStations = problem.cStations;
+    const TPriceTable& prices = problem.prices;
+    int nbVehicles = problem.nbVehicles;
+
     int numChargingPriorities = 5;
-    int chargingPriority = ceil(s.vec[s.vec.size() - 3].rk * numChargingPriorities + 0.000000000001);
-    double tempRK;
+    int chargingPriority = ceil(s.vec[s.vec.size() - 3] * numChargingPriorities + 0.000000000001);
 
-    // Create structure to store charger availabilities
-    int nbOfHours = ceil(elecPrices.size() * periodLength / 60.0);
-    std::vector<unsigned long long> charger(nbOfHours, 0);
-    std::vector<std::vector<unsigned long long>> chargingStation;
-    std::vector<std::vector<std::vector<unsigned long long>>> availability;
-    for (int i = 0; i < cStations.size(); i++) {
-        for (int j = 0; j < cStations[i].cap; j++) { // add cap ampount of chargers
-            chargingStation.push_back(charger);
-        }
-        availability.push_back(chargingStation);
-        chargingStation.clear();
-    }
+    // Charger reservations, kept per thread and only reset between schedules
+    static thread_local TChargerCalendar calendar;
+    calendar.Reset(cStations.size(), prices.Horizon());
 
     for (int i = 0; i < nbVehicles; i++) {
-        s.sol[i][0].B = vehicle[i].B0;
-        for (int j = 1; j < s.sol[i].size(); j++) {
-            s.sol[i][j].B = s.sol[i][j - 1].B - cons[s.sol[i][j-1].stop][s.sol[i][j].stop];
-        }
-        //from here on the charging scheduling procedure really starts
-        double r = vehicle[i].r;
-        double Q = vehicle[i].Q;
-        double tot_charg_needed = (r * Q - s.sol[i][s.sol[i].size()-1].B);        
-        if (tot_charg_needed <= 0) { continue; }
-        std::vector<ZL> poss(0); //possible nodes after which charging could occur
-        for (int j = 0; j < s.sol[i].size()-1; j++) {
-            if (s.sol[i][j].C == vehicle[i].C) {
-                // Find rk of this node
-                tempRK = -1.0;
-                if (s.sol[i][j].stop > 2 * nbUsers) { // Charging station or origin depot => no random key. Charging stations won't be picked anyway. For origin depot, set RK = rk of veh
-                    tempRK = s.vec[2*nbUsers + i].rk;
-                }
-                else { // Drop-offs
-                    tempRK = s.vec[s.sol[i][j].stop].rk; // Take drop-off gene
-                }
-                // Add zero-load
-                poss.push_back({ j, elecPrices[(s.sol[i][j].ET + node[s.sol[i][j].stop].d) / periodLength], s.sol[i][j+1].LT - node[s.sol[i][j].stop].d - s.sol[i][j].ET, tempRK});
-            }
-        }
-        // Set charging priority
-        switch (chargingPriority) {
-            case 1: // BY ELECTICITY PRICE
-                sort(poss.begin(), poss.end(), sortByEP); //sorting the possible nodes by electricity prices
-                break;
-            case 2: // EARLIEST FIRST
-                // No sort, just by order in route  
-                break;
-            case 3: // LATEST FIRST
-                std::reverse(poss.begin(), poss.end());
-                break;
-            case 4: // RK BASED
-                sort(poss.begin(), poss.end(), sortByRKsched);
-                break;
-            case 5: // BIGGEST WINDOWS FIRST
-                sort(poss.begin(), poss.end(), sortByWindow);
-                break;
-        }
-        double charg_assigned = 0;
-        while (charg_assigned < tot_charg_needed) {
-            if (poss.size() == 0) {
-                s.battery_infeasibles +=1;      //if there still is a need for charging, but there are no nodes available after which charging would be possible, the route/schedule is battery infeasible and the objective function of s will be penalised for this reason.
-                break;
-            }
-            int inspect = poss[0].node;         //node position after which we'll look to add charging
-            int stationIndex = -1;
-            TVecSol station=findClosestCharger(s.sol[i][inspect], s.sol[i][inspect+1], cStations, dist, node, availability, stationIndex) ; //Find closest fully available charger
-            if (station.stop == -1) {
-                poss.erase(poss.begin());              // If no available charger found, skip this zero-load
-                continue;
-            }
-            station.ET = 0;
-            station.LT = 480;
-            station.C = 3;
-            station.c_station = true;
-            double alpha;
-            for (int s = 0; s < cStations.size(); s++) {
-                if (station.stop == cStations[s].id - 1) {
-                    alpha = cStations[s].alpha;
-                    break;
-                }
-            }
-
-
-            //now we have a potential station to insert. Let's update the window of poss[0] taking into accounts travel times but also time windows preceding and following the station.
-            poss[0].window = poss[0].window - dist[s.sol[i][inspect].stop][station.stop] - dist[station.stop][s.sol[i][inspect + 1].stop];
-            double stationET= s.sol[i][inspect].ET + node[s.sol[i][inspect].stop].d + dist[s.sol[i][inspect].stop][station.stop]; //if the station gets inserted after inspect, the ET of charging would be ET of inspect + service time + travel time. The ET of the next node would be ET of station + charging duration + travel time.
-            double nextET = stationET + poss[0].window + dist[station.stop][s.sol[i][inspect + 1].stop]; //ET of next node if poss[0].window would be fully charged
-            //it could be that a charging duration of current value of poss[0] window would push the ET of nodes following the station past their LT. In such a case, poss[0] window should be made smaller.
-            if (nextET> s.sol[i][inspect + 1].LT) {
-                poss[0].window = s.sol[i][inspect + 1].LT - dist[station.stop][s.sol[i][inspect + 1].stop] - stationET;
-            }
-            double stationLT = s.sol[i][inspect + 1].LT - dist[station.stop][s.sol[i][inspect + 1].stop] - poss[0].window; //LT of charging if poss[0].window has to be fully charged
-            double precedingLT = stationLT - dist[s.sol[i][inspect].stop][station.stop] - node[s.sol[i][inspect].stop].d;
-            //it could be that a charging duration of current value of poss[0] window would push the LT of nodes preceding the station under their ET. In such a case, poss[0] window should be made smaller.
-            for (int j=inspect;j>0;j--){
-                if (s.sol[i][j].ET>precedingLT) {
-                    poss[0].window = poss[0].window - (s.sol[i][inspect].ET - precedingLT);
-                }
-                precedingLT = precedingLT - dist[s.sol[i][j-1].stop][s.sol[i][j].stop] - node[s.sol[i][j-1].stop].d - s.sol[i][j-1].w;
-            }
-            if (poss[0].window<= 0) {
-                poss.erase(poss.begin());              //if the window is negative, no charging is added and zeroload node is removed from zeroloads list.
-                continue;
-            }
-            if ((poss[0].window) * alpha - cons[s.sol[i][inspect].stop][station.stop] - cons[station.stop][s.sol[i][inspect + 1].stop] + cons[s.sol[i][inspect].stop][s.sol[i][inspect + 1].stop] <= 0) {
-                poss.erase(poss.begin());               //if maximum charging at node considering waiting time is lower than battery consumption of detour to station, no charging is added and zeroload node is removed from zeroloads list.
-                continue;
-            }
-            s.sol[i].insert(s.sol[i].begin() + inspect + 1, station);
-            tot_charg_needed += (cons[s.sol[i][inspect].stop][s.sol[i][inspect + 1].stop] + cons[s.sol[i][inspect+1].stop][s.sol[i][inspect + 2].stop] - cons[s.sol[i][inspect].stop][s.sol[i][inspect+2].stop]);
-            double cons_sum = 0;        //sum of battery consumptions from charging station to destination depot
-            for (int l = inspect+1; l < s.sol[i].size()-1; l++) {
-                cons_sum += cons[s.sol[i][l].stop][s.sol[i][l+1].stop];
-            }
-            //the charging added after the currently inspected node is bounded by four time limits: 1) charging time which would allow vehicle to reach destination depot with r*Q battery level from inspected node.   2) time to fully recharge.  3) waiting time - travel time of detour  4) charging time needed over full route not yet assigned
-            double a = (r * Q + cons_sum - std::max(s.sol[i][inspect].B - cons[s.sol[i][inspect].stop][s.sol[i][inspect + 1].stop], 0.0) )/ alpha;
-            double b = (Q - std::max(s.sol[i][inspect].B - cons[s.sol[i][inspect].stop][s.sol[i][inspect + 1].stop], 0.0) )/ alpha;
-            double c = poss[0].window;
-            double d = (tot_charg_needed - charg_assigned)/alpha;
-            double charge;
-            charge = std::min(a, b);
-            charge = std::min(charge, c);
-            charge = std::min(charge, d);      //this is the charging we'll add after the inspected node (unless charging this would mean a vehicle would have a higher battery level than Q somewhere further along the route)
-            for (int l = inspect + 2; l < s.sol[i].size(); l++) {    //check if charging now doesn't imply a battery level higher than Q somewhere further along the line
-                if (s.sol[i][l].B + s.sol[i][l].w*alpha + charge * alpha - (cons[s.sol[i][inspect].stop][s.sol[i][inspect + 1].stop] + cons[s.sol[i][inspect + 1].stop][s.sol[i][inspect + 2].stop] - cons[s.sol[i][inspect].stop][s.sol[i][inspect + 2].stop]) > Q) {
-                    charge = (Q - (s.sol[i][l].B + s.sol[i][l].w*alpha - (cons[s.sol[i][inspect].stop][s.sol[i][inspect + 1].stop] + cons[s.sol[i][inspect + 1].stop][s.sol[i][inspect + 2].stop] - cons[s.sol[i][inspect].stop][s.sol[i][inspect + 2].stop])) ) / alpha;
-                }
-            }
-            if (charge * alpha <= cons[s.sol[i][inspect].stop][s.sol[i][inspect + 1].stop] + cons[s.sol[i][inspect + 1].stop][s.sol[i][inspect + 2].stop] - cons[s.sol[i][inspect].stop][s.sol[i][inspect + 2].stop]) {     //if charging time ends up not being enough to compensate battery consumption of detour (+ room to charge extra), charging station is removed from route and zeroloads node is removed from zeroloads list.
-                tot_charg_needed = tot_charg_needed - (cons[s.sol[i][inspect].stop][s.sol[i][inspect + 1].stop] + cons[s.sol[i][inspect + 1].stop][s.sol[i][inspect + 2].stop] - cons[s.sol[i][inspect].stop][s.sol[i][inspect + 2].stop]);
-                s.sol[i].erase(s.sol[i].begin() + inspect + 1);
-                poss.erase(poss.begin());
-                continue;
-            }
-            s.sol[i][inspect + 1].ET = s.sol[i][inspect].ET + node[s.sol[i][inspect].stop].d + dist[s.sol[i][inspect].stop][s.sol[i][inspect + 1].stop] ;  //setting earliest time charging can begin
-            s.sol[i][inspect+1].LT = s.sol[i][inspect+2].LT - dist[s.sol[i][inspect+1].stop][s.sol[i][inspect+2].stop] - charge;   //setting latest time charging should start so charge time can be respected
-            s.sol[i][inspect].LT = std::min(s.sol[i][inspect].LT, s.sol[i][inspect + 1].LT - node[s.sol[i][inspect].stop].d - dist[s.sol[i][inspect].stop][s.sol[i][inspect + 1].stop]);   //LT of preceding drop-off is altered to be able to respect charging
-            s.sol[i][inspect + 2].ET = std::max(s.sol[i][inspect + 2].ET, s.sol[i][inspect + 1].ET + charge + dist[s.sol[i][inspect + 1].stop][s.sol[i][inspect + 2].stop]);   //ET of next pick-up is altered to be able to respect charging
-            updateAvailability(s.sol[i][inspect + 1].ET, s.sol[i][inspect + 1].LT + charge, stationIndex, cStations, availability); // Reserving whole time window for this vehicle at this station (since we exact charging session is only scheduled at the end)
-            for (int j = inspect - 1; j >= 0; j--) { //update LT "backwards" as long as needed
-                if (s.sol[i][j + 1].LT - dist[s.sol[i][j].stop][s.sol[i][j + 1] .stop] - node[s.sol[i][j].stop].d -s.sol[i][j].w < s.sol[i][j].LT) { // If LT needs to be updated
-                    s.sol[i][j].LT = s.sol[i][j + 1].LT - dist[s.sol[i][j].stop][s.sol[i][j+1].stop] - node[s.sol[i][j].stop].d - s.sol[i][j].w; // Update LT
-                }
-                else break; // Else, you can stop backwards updating
-            }
-            for (int j = inspect + 3; j < s.sol[i].size(); j++) {
-                if (s.sol[i][j - 1].ET + dist[s.sol[i][j - 1].stop][s.sol[i][j].stop] + node[s.sol[i][j - 1].stop].d + s.sol[i][j-1].w > s.sol[i][j].ET) { // If ET needs to be updated
-                    s.sol[i][j].ET = s.sol[i][j - 1].ET + dist[s.sol[i][j - 1].stop][s.sol[i][j].stop] + node[s.sol[i][j - 1].stop].d + s.sol[i][j - 1].w; // Update ET
-                }
-                else break; // Else, you can stop forwards updating
-            }
-            s.sol[i][inspect + 1].w = charge; //the charging duration for a charging station is stored in the w variable
-            s.sol[i][inspect + 1].B = s.sol[i][inspect].B - cons[s.sol[i][inspect].stop][s.sol[i][inspect + 1].stop]; //setting B at start of charging
-            s.sol[i][inspect + 2].B= s.sol[i][inspect+1].B + charge*alpha - cons[s.sol[i][inspect+1].stop][s.sol[i][inspect + 2].stop]; //setting B of node just after charging station
-            for (int l = inspect + 3; l < s.sol[i].size(); l++) {  //updating battery levels forward
-                s.sol[i][l].B = s.sol[i][l].B + charge*alpha - (cons[s.sol[i][inspect].stop][s.sol[i][inspect + 1].stop] + cons[s.sol[i][inspect + 1].stop][s.sol[i][inspect + 2].stop] - cons[s.sol[i][inspect].stop][s.sol[i][inspect + 2].stop]);
-            } 
-            charg_assigned += charge*alpha;
-            poss.erase(poss.begin());
-            for (int p = 0; p < poss.size(); p++) {        //updating node positions in poss if position>inspect because charging station was just inserted in inspect + 1
-                if (poss[p].node > inspect) {
-                    poss[p].node = poss[p].node + 1;
-                }
-            }
+        if (cache == nullptr) {
+            InsertChargingStations(s, i, chargingPriority, problem, calendar);
+            continue;
         }
+        // A route scheduled before keeps its charging stations if the chargers it asked for give the same answers
+        if (cache->Reuse(s, i, calendar)) continue;
+        TScheduleCache::TEntry& entry = cache->Claim(i, s.sol[i]);
+        int infeasibles = s.battery_infeasibles;
+        calendar.log = &entry.events;
+        InsertChargingStations(s, i, chargingPriority, problem, calendar);
+        calendar.log = nullptr;
+        entry.output = s.sol[i];
+        entry.batteryInfeasible = s.battery_infeasibles - infeasibles;
     }
     if (s.battery_infeasibles > 0) { 
-        s.fo = objFct(s, node, dist, nbVehicles, nbUsers,periodLength, maxRideTimes, weights, elecPrices);
+        s.fo = objFct(s, problem);
         return s; }
 
     //at this point charging stations have been inserted and charges have been determined. Now the time variables, respecting the time windows, have to be determined.
     // Based on scheduler gene: either naive "late pickup, late charging, early drop-off" or "RK-based pickup, ??? charging, early drop-off
 
     int numSchedulers = 2;
-    int sched = ceil(s.vec[s.vec.size() - 2].rk * numSchedulers + 0.000000000001);
+    int sched = ceil(s.vec[s.vec.size() - 2] * numSchedulers + 0.000000000001);
 
     switch (sched)
     {
     case 1:
-        ScheduleLatePUEarlyDO(s, nbVehicles, nbUsers, node, dist, elecPrices, periodLength);
+        ScheduleLatePUEarlyDO(s, problem);
         break;
     case 2:
-        ScheduleRkPUEarlyDO(s, nbVehicles, nbUsers, node, dist, elecPrices, periodLength);
+        ScheduleRkPUEarlyDO(s, problem);
         break;
     }
 
@@ -208,118 +73,389 @@ TSol Scheduler(TSol s, std::vector <TNode>& node, std::vector <std::vector <doub
 
 }
 
-TVecSol findClosestCharger(TVecSol node1, TVecSol node2, std::vector <TCstat> cStations, std::vector <std::vector <double> >& dist, std::vector <TNode>& node, std::vector<std::vector<std::vector<unsigned long long>>>& availability, int & stationIndex) {
-    TVecSol station;
-    station.stop = -1; // For checking if station has been found
-    int extra = 1000000;
-    int stop1 = node1.stop;
-    int stop2 = node2.stop;
-    float start;
-    float end;
-    for (int s = 0; s < cStations.size(); s++) {
-        start = node1.ET + node[node1.stop].d + dist[node1.stop][cStations[s].id-1]; // Soonest time charging could start at this station
-        end = node2.LT - dist[cStations[s].id - 1][node2.stop];
-        if (dist[stop1][cStations[s].id-1] + dist[cStations[s].id-1][stop2] < extra) { // If closest
-            if (checkAvailability(start, end, s, cStations, availability)) { // AND if available
-                extra = dist[stop1][cStations[s].id - 1] + dist[cStations[s].id - 1][stop2];
-                station.stop = cStations[s].id - 1;
-                stationIndex = s;
-            }
-        }
+TSol PortfolioScheduler(TSol s, const TProblem& problem)
+{
+    const std::vector <TCstat>& cStations = problem.cStations;
+    const TPriceTable& prices = problem.prices;
+    int nbVehicles = problem.nbVehicles;
+
+    const int numChargingPriorities = 5;
+    const int numSchedulers = 2;
+    int ownPriority = ceil(s.vec[s.vec.size() - 3] * numChargingPriorities + 0.000000000001);
+    int ownSched = ceil(s.vec[s.vec.size() - 2] * numSchedulers + 0.000000000001);
+
+    // Charging of a route under one charging priority
+    struct TCharging
+    {
+        int source;                             // charging priority whose run holds the result
+        int inspected;                          // zero-loads inspected (the result only depends on these)
+        int batteryInfeasible;
+        TRoute output;
+        std::vector <int> order;                // zero-loads in the order they are inspected
+        std::vector <TChargerCalendar::TEvent> events;
+    };
+    static thread_local std::vector <TCharging> charging;   // nbVehicles x numChargingPriorities
+    static thread_local std::vector <std::vector <ZL> > zeroLoads;
+    static thread_local std::vector <double> needed;
+    static thread_local std::vector <ZL> poss;
+    static thread_local TChargerCalendar calendar;
+    static thread_local TSol charged, scheduled, best;
+    if ((int)charging.size() < nbVehicles * numChargingPriorities) charging.resize(nbVehicles * numChargingPriorities);
+    if ((int)zeroLoads.size() < nbVehicles) zeroLoads.resize(nbVehicles);
+    if ((int)needed.size() < nbVehicles) needed.resize(nbVehicles);
+
+    // The battery levels and zero-loads of the routes do not depend on the policies
+    for (int i = 0; i < nbVehicles; i++) {
+        needed[i] = FindZeroLoads(s, i, problem, zeroLoads[i]);
     }
-    return station;
-}
 
-bool checkAvailability(float start, float end, int csIndex, std::vector <TCstat> cStations, std::vector<std::vector<std::vector<unsigned long long>>>& availability) {
-    unsigned long long session = 0;
-    unsigned long long available;
+    double fo[numChargingPriorities + 1][numSchedulers + 1];
+    double bestFo = INFINITY;
+    int bestPriority = 0;
+    int bestSched = 0;
+    for (int p = 1; p <= numChargingPriorities; p++) {
+        calendar.Reset(cStations.size(), prices.Horizon());
+        charged = s;
+        for (int i = 0; i < nbVehicles; i++) {
+            TCharging& run = charging[i * numChargingPriorities + p - 1];
+            run.source = 1;                     // a route without zero-loads to charge is the same under all priorities
+            if (needed[i] <= 0) continue;
+            run.source = p;
+            poss = zeroLoads[i];
+            OrderZeroLoads(poss, p);
+            run.order.resize(poss.size());
+            for (int k = 0; k < (int)poss.size(); k++) run.order[k] = poss[k].node;
 
-    // For each hour
-    for (int hour = 0; hour < availability[csIndex][0].size(); hour++) {
-        session = 0;
-        if (start > (hour + 1) * 60) { // If session happens after this hour
-            continue;
+            // An earlier priority that inspected the same zero-loads first took the same decisions if the chargers give the same answers
+            for (int q = 1; q < p && run.source == p; q++) {
+                const TCharging& prev = charging[i * numChargingPriorities + q - 1];
+                if (prev.source != q || !std::equal(prev.order.begin(), prev.order.begin() + prev.inspected, run.order.begin())) continue;
+                if (calendar.Replay(prev.events)) {
+                    charged.sol[i] = prev.output;
+                    charged.battery_infeasibles += prev.batteryInfeasible;
+                    run.source = q;
+                }
+            }
+            if (run.source != p) continue;
+            int infeasibles = charged.battery_infeasibles;
+            run.events.clear();
+            calendar.log = &run.events;
+            run.inspected = ChargeZeroLoads(charged, i, poss, needed[i], problem, calendar);
+            calendar.log = nullptr;
+            run.output = charged.sol[i];
+            run.batteryInfeasible = charged.battery_infeasibles - infeasibles;
         }
-        else if (start > hour * 60 && start <= (hour + 1) * 60) { // If start during this hour
-            if (end > hour * 60 && end <= (hour + 1) * 60) { // If end during hour
-                session = (unsigned long long)pow(2, (int)floor(end - hour * 60)) - 1 ^ (unsigned long long) pow(2, (int)floor(start - hour * 60)) - 1; // Set bitwise session
+
+        // Same charging as an earlier priority: same schedules
+        int twin = 0;
+        for (int q = 1; q < p && twin == 0; q++) {
+            twin = q;
+            for (int i = 0; i < nbVehicles; i++) {
+                if (charging[i * numChargingPriorities + p - 1].source != charging[i * numChargingPriorities + q - 1].source) {
+                    twin = 0;
+                    break;
+                }
             }
-            else { // Departure must be after hour if not during
-                session = (unsigned long long)pow(2, 60) - 1 ^ (unsigned long long) pow(2, (int)ceil(start - hour * 60)) - 1; // Set bitwise session
+        }
+        if (twin > 0) {
+            for (int sched = 1; sched <= numSchedulers; sched++) {
+                fo[p][sched] = fo[twin][sched];
+                if (p == ownPriority && sched == ownSched && bestPriority == twin && bestSched == sched) bestPriority = p;
             }
+            continue;
         }
-        else { // Arrival happens before this hour
-            if (end <= hour * 60) { // If departure also before this hour
-                break; // Then you have already checked whole session
+
+        // a battery infeasible charging is not scheduled, its objective value is the penalty
+        double penalty = (charged.battery_infeasibles > 0) ? objFct(charged, problem) : 0;
+        for (int sched = 1; sched <= numSchedulers; sched++) {
+            if (charged.battery_infeasibles > 0) {
+                fo[p][sched] = penalty;
             }
-            else if (end > hour * 60 && end <= (hour + 1) * 60) { // If departure during hour
-                session = (unsigned long long)pow(2, (int)floor(end - hour * 60)) - 1; // Set bitwise session
+            else {
+                scheduled = charged;
+                switch (sched)
+                {
+                case 1:
+                    ScheduleLatePUEarlyDO(scheduled, problem);
+                    break;
+                case 2:
+                    ScheduleRkPUEarlyDO(scheduled, problem);
+                    break;
+                }
+                scheduled.scheduled = true;
+                fo[p][sched] = objFct(scheduled, problem);
             }
-            else { // Departure must be after hour if not during
-                session = (unsigned long long)pow(2, 60) - 1; // Set bitwise session
+            // ties keep the policies the keys already choose
+            if (fo[p][sched] < bestFo || (fo[p][sched] == bestFo && p == ownPriority && sched == ownSched)) {
+                bestFo = fo[p][sched];
+                bestPriority = p;
+                bestSched = sched;
+                best = (charged.battery_infeasibles > 0) ? charged : scheduled;
             }
         }
+    }
+
+    // Write the chosen policies back into the keys (in the middle of their intervals)
+    best.vec[best.vec.size() - 3] = (bestPriority - 0.5) / numChargingPriorities;
+    best.vec[best.vec.size() - 2] = (bestSched - 0.5) / numSchedulers;
+    if (!best.scheduled) best.fo = bestFo;
+    return best;
+}
+
+void InsertChargingStations(TSol& s, int i, int chargingPriority, const TProblem& problem, TChargerCalendar& calendar)
+{
+    static thread_local std::vector<ZL> poss; //possible nodes after which charging could occur
 
-        // Check session against availability
-        available = availability[csIndex][cStations[csIndex].cap-1][hour]; // This is the "charging plug" with the highest index. 
-        //Since charging plugs with lowest index are always "filled" first, the one with the highest index only has 1's if charging station is at full capacity
+    double tot_charg_needed = FindZeroLoads(s, i, problem, poss);
+    if (tot_charg_needed <= 0) { return; }
+    OrderZeroLoads(poss, chargingPriority);
+    ChargeZeroLoads(s, i, poss, tot_charg_needed, problem, calendar);
+}
 
-        if (available & session) { // If there is at least 1 minute during the session at which capacity would be exceeded => Not allowed
-            return false;
+static double FindZeroLoads(TSol& s, int i, const TProblem& problem, std::vector<ZL>& poss)
+{
+    const std::vector <TNode>& node = problem.node;
+    const TMatrix& dist = problem.dist;
+    double dischRate = problem.dischRate;
+    const std::vector <TVhcl>& vehicle = problem.vehicle;
+    const TPriceTable& prices = problem.prices;
+    int nbUsers = problem.nbUsers;
+
+    double tempRK;
+
+    const int* stop = s.sol[i].stop;
+    double* B = s.sol[i].B;
+    B[0] = vehicle[i].B0;
+    for (int j = 1; j < s.sol[i].size(); j++) {
+        B[j] = B[j - 1] - dischRate * dist[stop[j - 1]][stop[j]];
+    }
+    //from here on the charging scheduling procedure really starts
+    double r = vehicle[i].r;
+    double Q = vehicle[i].Q;
+    double tot_charg_needed = (r * Q - s.sol[i][s.sol[i].size()-1].B);        
+    poss.clear();
+    if (tot_charg_needed <= 0) { return tot_charg_needed; }
+    for (int j = 0; j < s.sol[i].size()-1; j++) {
+        if (s.sol[i][j].C == vehicle[i].C) {
+            // Find rk of this node
+            tempRK = -1.0;
+            if (s.sol[i][j].stop > 2 * nbUsers) { // Charging station or origin depot => no random key. Charging stations won't be picked anyway. For origin depot, set RK = rk of veh
+                tempRK = s.vec[2*nbUsers + i];
+            }
+            else { // Drop-offs
+                tempRK = s.vec[s.sol[i][j].stop]; // Take drop-off gene
+            }
+            // Add zero-load
+            poss.push_back({ j, prices.Price(s.sol[i][j].ET + node[s.sol[i][j].stop].d), s.sol[i][j+1].LT - node[s.sol[i][j].stop].d - s.sol[i][j].ET, tempRK, j});
         }
     }
+    return tot_charg_needed;
+}
 
-    return true;
+static void OrderZeroLoads(std::vector<ZL>& poss, int chargingPriority)
+{
+    // Set charging priority
+    switch (chargingPriority) {
+        case 1: // BY ELECTICITY PRICE
+            sort(poss.begin(), poss.end(), sortByEP); //sorting the possible nodes by electricity prices
+            break;
+        case 2: // EARLIEST FIRST
+            // No sort, just by order in route  
+            break;
+        case 3: // LATEST FIRST
+            std::reverse(poss.begin(), poss.end());
+            break;
+        case 4: // RK BASED
+            sort(poss.begin(), poss.end(), sortByRKsched);
+            break;
+        case 5: // BIGGEST WINDOWS FIRST
+            sort(poss.begin(), poss.end(), sortByWindow);
+            break;
+    }
 }
 
-void updateAvailability(float start, float end, int csIndex, std::vector <TCstat> cStations, std::vector<std::vector<std::vector<unsigned long long>>>& availability) {
-    unsigned long long session = 0;
-    unsigned long long auxULL = 0;
+static int ChargeZeroLoads(TSol& s, int i, std::vector<ZL>& poss, double tot_charg_needed, const TProblem& problem, TChargerCalendar& calendar)
+{
+    const std::vector <TNode>& node = problem.node;
+    const TMatrix& dist = problem.dist;
+    double dischRate = problem.dischRate;
+    const std::vector <TVhcl>& vehicle = problem.vehicle;
+    const std::vector <TCstat>& cStations = problem.cStations;
+
+    const int* stop = s.sol[i].stop;
+    double* B = s.sol[i].B;
+    double r = vehicle[i].r;
+    double Q = vehicle[i].Q;
 
-    // For each hour
-    for (int hour = 0; hour < availability[csIndex][0].size(); hour++) {
-        session = 0;
-        if (start > (hour + 1) * 60) { // If session happens after this hour
+    // Battery levels by slot of the route as given (see TBatteryProfile): only a charging station adds its charge to the level
+    int size = s.sol[i].size();
+    static thread_local TBatteryProfile profile;
+    static thread_local std::vector <double> suffix;    // consumption from stop j of the route as given to its end
+    static thread_local std::vector <char> charged;     // a charging station was inserted after stop j
+    profile.Reset(size);
+    suffix.assign(size, 0.0);
+    charged.assign(size, 0);
+    for (int j = size - 2; j >= 0; j--) {
+        suffix[j] = suffix[j + 1] + dischRate * dist[stop[j]][stop[j + 1]];
+    }
+    for (int j = 0; j < size; j++) {
+        double level = B[j];
+        if (s.sol[i].c_station[j]) {
+            for (int cs = 0; cs < cStations.size(); cs++) {
+                if (stop[j] == cStations[cs].id - 1) level += s.sol[i].w[j] * cStations[cs].alpha;
+            }
+        }
+        profile.Set(2 * j, B[j], level);
+    }
+
+    double charg_assigned = 0;
+    bool inserted = false;                  // a charging station was kept
+    int next = 0;                           // poss[next..] are the zero-loads left to inspect
+    while (charg_assigned < tot_charg_needed - 0.000000001) {     // a shortfall left by rounding (the levels come from sums taken in another order than the route) is not charged for
+        if (next == poss.size()) {
+            s.battery_infeasibles +=1;      //if there still is a need for charging, but there are no nodes available after which charging would be possible, the route/schedule is battery infeasible and the objective function of s will be penalised for this reason.
+            break;
+        }
+        int inspect = poss[next].node;         //node position after which we'll look to add charging
+        int stationIndex = -1;
+        TVecSol station=findClosestCharger(s.sol[i][inspect], s.sol[i][inspect+1], problem, calendar, stationIndex) ; //Find closest fully available charger
+        if (station.stop == -1) {
+            next++;                             // If no available charger found, skip this zero-load
             continue;
         }
-        else if (start > hour * 60 && start <= (hour + 1) * 60) { // If arrival during this hour
-            if (end > hour * 60 && end <= (hour + 1) * 60) { // If departure during hour
-                session = (unsigned long long)pow(2, (int)floor(end - hour * 60)) - 1 ^ (unsigned long long) pow(2, (int)ceil(start - hour * 60)) - 1; // Set bitwise session
-            }
-            else { // Departure must be after hour if not during
-                session = (unsigned long long)pow(2, 60) - 1 ^ (unsigned long long) pow(2, (int)ceil(start - hour * 60)) - 1; // Set bitwise session
+        station.ET = 0;
+        station.LT = 480;
+        station.C = 3;
+        station.c_station = true;
+        double alpha;
+        for (int s = 0; s < cStations.size(); s++) {
+            if (station.stop == cStations[s].id - 1) {
+                alpha = cStations[s].alpha;
+                break;
             }
         }
-        else { // Arrival happens before this hour
-            if (end <= hour * 60) { // If departure also before this hour
-                break; // Then you have already checked whole session
-            }
-            else if (end > hour * 60 && end <= (hour + 1) * 60) { // If departure during hour
-                session = (unsigned long long)pow(2, (int)floor(end - hour * 60)) - 1; // Set bitwise session
+
+
+        //now we have a potential station to insert. Let's update the window of poss[next] taking into accounts travel times but also time windows preceding and following the station.
+        poss[next].window = poss[next].window - dist[s.sol[i][inspect].stop][station.stop] - dist[station.stop][s.sol[i][inspect + 1].stop];
+        double stationET= s.sol[i][inspect].ET + node[s.sol[i][inspect].stop].d + dist[s.sol[i][inspect].stop][station.stop]; //if the station gets inserted after inspect, the ET of charging would be ET of inspect + service time + travel time. The ET of the next node would be ET of station + charging duration + travel time.
+        double nextET = stationET + poss[next].window + dist[station.stop][s.sol[i][inspect + 1].stop]; //ET of next node if poss[next].window would be fully charged
+        //it could be that a charging duration of current value of poss[next] window would push the ET of nodes following the station past their LT. In such a case, poss[next] window should be made smaller.
+        if (nextET> s.sol[i][inspect + 1].LT) {
+            poss[next].window = s.sol[i][inspect + 1].LT - dist[station.stop][s.sol[i][inspect + 1].stop] - stationET;
+        }
+        double stationLT = s.sol[i][inspect + 1].LT - dist[station.stop][s.sol[i][inspect + 1].stop] - poss[next].window; //LT of charging if poss[next].window has to be fully charged
+        double precedingLT = stationLT - dist[s.sol[i][inspect].stop][station.stop] - node[s.sol[i][inspect].stop].d;
+        //it could be that a charging duration of current value of poss[next] window would push the LT of nodes preceding the station under their ET. In such a case, poss[next] window should be made smaller.
+        for (int j=inspect;j>0;j--){
+            if (s.sol[i][j].ET>precedingLT) {
+                poss[next].window = poss[next].window - (s.sol[i][inspect].ET - precedingLT);
             }
-            else { // Departure must be after hour if not during
-                session = (unsigned long long)pow(2, 60) - 1; // Set bitwise session
+            precedingLT = precedingLT - dist[s.sol[i][j-1].stop][s.sol[i][j].stop] - node[s.sol[i][j-1].stop].d - s.sol[i][j-1].w;
+        }
+        if (poss[next].window<= 0) {
+            next++;                             //if the window is negative, no charging is added and zeroload node is removed from zeroloads list.
+            continue;
+        }
+        if ((poss[next].window) * alpha - dischRate * dist[s.sol[i][inspect].stop][station.stop] - dischRate * dist[station.stop][s.sol[i][inspect + 1].stop] + dischRate * dist[s.sol[i][inspect].stop][s.sol[i][inspect + 1].stop] <= 0) {
+            next++;                              //if maximum charging at node considering waiting time is lower than battery consumption of detour to station, no charging is added and zeroload node is removed from zeroloads list.
+            continue;
+        }
+        s.sol[i].insert(inspect + 1, station);
+        stop = s.sol[i].stop;               // the insertion may have moved the arrays of the route
+        int slot = 2 * poss[next].origin;   // slot of the inspected zero-load, the station goes in slot + 1
+        double detour = dischRate * dist[stop[inspect]][stop[inspect + 1]] + dischRate * dist[stop[inspect + 1]][stop[inspect + 2]] - dischRate * dist[stop[inspect]][stop[inspect + 2]]; // extra consumption of the detour to the station
+        tot_charg_needed += detour;
+        //sum of battery consumptions from charging station to destination depot: the arc to the next stop, the rest of the route as given and the detours to the stations inserted after it
+        double cons_sum = dischRate * dist[stop[inspect + 1]][stop[inspect + 2]] + suffix[poss[next].origin + 1] + profile.Detours(slot + 2);
+        double stationB = profile.Level(slot) - dischRate * dist[stop[inspect]][stop[inspect + 1]]; // B at the start of charging
+        //the charging added after the currently inspected node is bounded by four time limits: 1) charging time which would allow vehicle to reach destination depot with r*Q battery level from inspected node.   2) time to fully recharge.  3) waiting time - travel time of detour  4) charging time needed over full route not yet assigned
+        double a = (r * Q + cons_sum - std::max(stationB, 0.0) )/ alpha;
+        double b = (Q - std::max(stationB, 0.0) )/ alpha;
+        double c = poss[next].window;
+        double d = (tot_charg_needed - charg_assigned)/alpha;
+        double charge;
+        charge = std::min(a, b);
+        charge = std::min(charge, c);
+        charge = std::min(charge, d);      //this is the charging we'll add after the inspected node (unless charging this would mean a vehicle would have a higher battery level than Q somewhere further along the route)
+        double peak = profile.Peak(slot + 2);      //check if charging now doesn't imply a battery level higher than Q somewhere further along the line
+        if (peak + charge * alpha - detour > Q) {
+            charge = (Q - (peak - detour)) / alpha;
+        }
+        if (charge * alpha <= detour) {     //if charging time ends up not being enough to compensate battery consumption of detour (+ room to charge extra), charging station is removed from route and zeroloads node is removed from zeroloads list.
+            tot_charg_needed = tot_charg_needed - detour;
+            s.sol[i].erase(inspect + 1);
+            next++;
+            continue;
+        }
+        s.sol[i][inspect + 1].ET = s.sol[i][inspect].ET + node[s.sol[i][inspect].stop].d + dist[s.sol[i][inspect].stop][s.sol[i][inspect + 1].stop] ;  //setting earliest time charging can begin
+        s.sol[i][inspect+1].LT = s.sol[i][inspect+2].LT - dist[s.sol[i][inspect+1].stop][s.sol[i][inspect+2].stop] - charge;   //setting latest time charging should start so charge time can be respected
+        s.sol[i][inspect].LT = std::min(s.sol[i][inspect].LT, s.sol[i][inspect + 1].LT - node[s.sol[i][inspect].stop].d - dist[s.sol[i][inspect].stop][s.sol[i][inspect + 1].stop]);   //LT of preceding drop-off is altered to be able to respect charging
+        s.sol[i][inspect + 2].ET = std::max(s.sol[i][inspect + 2].ET, s.sol[i][inspect + 1].ET + charge + dist[s.sol[i][inspect + 1].stop][s.sol[i][inspect + 2].stop]);   //ET of next pick-up is altered to be able to respect charging
+        calendar.Reserve(stationIndex, s.sol[i][inspect + 1].ET, s.sol[i][inspect + 1].LT + charge); // Reserving whole time window for this vehicle at this station (since we exact charging session is only scheduled at the end)
+        TightenLT(s.sol[i], inspect - 1, 0, problem); //update LT "backwards" as long as needed
+        TightenET(s.sol[i], inspect + 3, problem); //update ET "forwards" as long as needed
+        s.sol[i][inspect + 1].w = charge; //the charging duration for a charging station is stored in the w variable
+        profile.Set(slot + 1, stationB, stationB + charge * alpha); //setting B at start of charging
+        profile.Add(slot + 2, charge * alpha - detour);   //updating battery levels forward (the B of the route are set at the end)
+        profile.AddDetour(slot + 1, detour);
+        charged[poss[next].origin] = 1;
+        inserted = true;
+        charg_assigned += charge*alpha;
+        next++;
+        for (int p = next; p < poss.size(); p++) {        //updating node positions in poss if position>inspect because charging station was just inserted in inspect + 1
+            if (poss[p].node > inspect) {
+                poss[p].node = poss[p].node + 1;
             }
         }
+    }
 
-        // Update availability
-        for (int c = 0; c < cStations[csIndex].cap; c++) {
-            auxULL = availability[csIndex][c][hour] & session;
-            availability[csIndex][c][hour] = availability[csIndex][c][hour] | session;
-            session = auxULL; // Whaatever could not be alloted to charger is carried over to allot to next charger
+    // Battery levels of the route with its charging stations
+    if (inserted) {
+        B = s.sol[i].B;
+        int l = 0;
+        for (int j = 0; j < size; j++) {
+            B[l++] = profile.Level(2 * j);
+            if (charged[j]) B[l++] = profile.Level(2 * j + 1);
         }
-        // Now session should == 0
-        if (session) {
-            int debug = 0;
+    }
+    return next;
+}
+
+TVecSol findClosestCharger(const TVecSol& node1, const TVecSol& node2, const TProblem& problem, TChargerCalendar& calendar, int & stationIndex) {
+    const std::vector <TNode>& node = problem.node;
+    const TMatrix& dist = problem.dist;
+    const std::vector <TCstat>& cStations = problem.cStations;
+    const uint16_t* closest = problem.closestStations(node1.stop, node2.stop);
+    int nbStations = problem.closestStations.nbStations;
+
+    TVecSol station;
+    station.stop = -1; // For checking if station has been found
+    float start;
+    float end;
+    // Stations are listed by increasing detour, so the first available one is the closest
+    for (int k = 0; k < nbStations && closest[k] != TStationTable::noStation; k++) {
+        int s = closest[k];
+        start = node1.ET + node[node1.stop].d + dist[node1.stop][cStations[s].id-1]; // Soonest time charging could start at this station
+        end = node2.LT - dist[cStations[s].id - 1][node2.stop];
+        if (calendar.Fits(s, start, end, cStations[s].cap)) {
+            station.stop = cStations[s].id - 1;
+            stationIndex = s;
+            break;
         }
     }
+    return station;
 }
 
-void ScheduleLatePUEarlyDO(TSol& s, int nbVehicles, int nbUsers, std::vector <TNode>& node, std::vector <std::vector <double> >& dist, std::vector <double> elecPrices, int periodLength) {
+void ScheduleLatePUEarlyDO(TSol& s, const TProblem& problem) {
+    const std::vector <TNode>& node = problem.node;
+    const TMatrix& dist = problem.dist;
+    const TPriceTable& prices = problem.prices;
+    int nbVehicles = problem.nbVehicles;
+    int nbUsers = problem.nbUsers;
+
     double priceET;
     double priceLT;
-    int ETPeriod;
-    int LTPeriod;
 
     for (int i = 0; i < nbVehicles; i++) {
         s.sol[i][0].T = 0;
@@ -328,12 +464,8 @@ void ScheduleLatePUEarlyDO(TSol& s, int nbVehicles, int nbUsers, std::vector <TN
                 s.sol[i][j].T = s.sol[i][j].LT;
             }
             else if (s.sol[i][j].c_station) { // Charging station
-                ETPeriod = floor(s.sol[i][j].ET / periodLength);
-                LTPeriod = floor((s.sol[i][j].LT + s.sol[i][j].w) / periodLength);
-                if (ETPeriod == elecPrices.size()) { ETPeriod--; } // Correction for edgecase where ET == time horizon
-                if (LTPeriod == elecPrices.size()) { LTPeriod--; } // Correction for edgecase where LT+w == time horizon
-                priceET = elecPrices[ETPeriod];
-                priceLT = elecPrices[LTPeriod];
+                priceET = prices.Price(s.sol[i][j].ET);
+                priceLT = prices.Price(s.sol[i][j].LT + s.sol[i][j].w); // Price at the end of the latest session
                 if (priceLT <= priceET) { // If late is cheaper
                     s.sol[i][j].T = s.sol[i][j].LT;
                 }
@@ -348,13 +480,16 @@ void ScheduleLatePUEarlyDO(TSol& s, int nbVehicles, int nbUsers, std::vector <TN
     }
 }
 
-void ScheduleRkPUEarlyDO(TSol& s, int nbVehicles, int nbUsers, std::vector <TNode>& node, std::vector <std::vector <double> >& dist, std::vector <double> elecPrices, int periodLength) {
+void ScheduleRkPUEarlyDO(TSol& s, const TProblem& problem) {
+    const std::vector <TNode>& node = problem.node;
+    const TMatrix& dist = problem.dist;
+    const TPriceTable& prices = problem.prices;
+    int nbVehicles = problem.nbVehicles;
+    int nbUsers = problem.nbUsers;
 
     float RK;
     double priceET;
     double priceLT;
-    int ETPeriod;
-    int LTPeriod;
     int precision = 1000000;
 
     for (int i = 0; i < nbVehicles; i++) {
@@ -366,7 +501,7 @@ void ScheduleRkPUEarlyDO(TSol& s, int nbVehicles, int nbUsers, std::vector <TNod
                     s.sol[i][j].T = s.sol[i][j].LT; // Schedule as late as possible
                 }
                 else { // Else, RK-based
-                    RK = s.vec[s.sol[i][j].stop].rk; // Get true random key
+                    RK = s.vec[s.sol[i][j].stop]; // Get true random key
                     RK = (float)((int)(RK * precision) % (precision / nbVehicles)) / (float)precision; // "Filtered" random key
                     RK =  RK * (float)nbVehicles; // Scaled filtered random-key
                     s.sol[i][j].T = std::max(
@@ -379,12 +514,8 @@ void ScheduleRkPUEarlyDO(TSol& s, int nbVehicles, int nbUsers, std::vector <TNod
                 }
             }
             else if (s.sol[i][j].c_station) { // Charging station
-                ETPeriod = floor(s.sol[i][j].ET / periodLength);
-                LTPeriod = floor((s.sol[i][j].LT + s.sol[i][j].w) / periodLength);
-                if (ETPeriod == elecPrices.size()) { ETPeriod--; } // Correction for edgecase where ET == time horizon
-                if (LTPeriod == elecPrices.size()) { LTPeriod--; } // Correction for edgecase where LT+w == time horizon
-                priceET = elecPrices[ETPeriod];
-                priceLT = elecPrices[LTPeriod];
+                priceET = prices.Price(s.sol[i][j].ET);
+                priceLT = prices.Price(s.sol[i][j].LT + s.sol[i][j].w); // Price at the end of the latest session
                 if (priceLT <= priceET) { // If late is cheaper
                     s.sol[i][j].T = s.sol[i][j].LT;
                 }
@@ -2,45 +2,53 @@
 #include <math.h>
 #include <algorithm>
 #include "Data.h"
+#include "ChargerCalendar.h"
+#include "BatteryProfile.h"
+#include "ScheduleCache.h"
 
 /************************************************************************************
  Method: Scheduler()
- Description: Takes a routing solution as argument and returns the solution with time variables (charging decisions will be included in the method later)
+ Description: Takes a routing solution as argument and returns the solution with time variables (charging decisions will be included in the method later).
+ If cache is not nullptr, routes it holds keep their stored charging stations (see TScheduleCache) and the others are stored in it.
 *************************************************************************************/
-TSol Scheduler(TSol s, std::vector <TNode>& node, std::vector <std::vector <double> > &dist, std::vector <TVhcl> vehicle, int nbUsers,
-    int nbVehicles, int periodLength, std::vector <TCstat> cStations, std::vector <int> maxRideTimes, double weights[3], std::vector <double> elecPrices, std::vector <std::vector <double> > &cons);
+TSol Scheduler(TSol s, const TProblem& problem, TScheduleCache* cache);
 
 /************************************************************************************
- Method: findClosestCharger
- Description: Finds closest charger for which the intial time window of the zeroload is completely available
+ Method: PortfolioScheduler()
+ Description: Schedules s as Scheduler() under each charging priority and scheduler and returns the solution with the lowest
+ objective value, with the keys of the charging priority and scheduler set to the ones that gave it (ties keep the choice of
+ the keys). The battery levels and zero-loads of the routes are found once; both schedulers are run on each charging of the
+ routes, and a route whose zero-loads are inspected in the same order as under an earlier charging priority reuses its
+ charging sessions if the chargers give the same answers.
 *************************************************************************************/
-TVecSol findClosestCharger(TVecSol node1, TVecSol node2, std::vector <TCstat> cStations, std::vector <std::vector <double> >& dist, std::vector <TNode>& node, std::vector<std::vector<std::vector<unsigned long long>>>& availability, int& stationIndex);
+TSol PortfolioScheduler(TSol s, const TProblem& problem);
 
 /************************************************************************************
- Method: checkAvailability
- Description: Checks whether chargign station with index 'csIndex' is available for the full period between start and end
- Returns: true if available, false if at max capacity during at least 1 minute of the interval
+ Method: InsertChargingStations
+ Description: Sets the battery levels of route i of s and inserts the charging sessions it needs after its zero-load points,
+ taken in the order given by chargingPriority, reserving the chargers in calendar. Counts the route in s.battery_infeasibles
+ if it cannot be charged enough.
 *************************************************************************************/
-bool checkAvailability(float start, float end, int csIndex, std::vector <TCstat> cStations, std::vector<std::vector<std::vector<unsigned long long>>>& availability);
+void InsertChargingStations(TSol& s, int i, int chargingPriority, const TProblem& problem, TChargerCalendar& calendar);
 
 /************************************************************************************
- Method: updateAvailability
- Description: Updates a charging session at charging station with index csIndex from 'start' to 'end'
+ Method: findClosestCharger
+ Description: Finds closest charger for which the intial time window of the zeroload is completely available in calendar
 *************************************************************************************/
-void updateAvailability(float start, float end, int csIndex, std::vector <TCstat> cStations, std::vector<std::vector<std::vector<unsigned long long>>>& availability);
+TVecSol findClosestCharger(const TVecSol& node1, const TVecSol& node2, const TProblem& problem, TChargerCalendar& calendar, int& stationIndex);
 
 /************************************************************************************
 Method: ScheduleLatePUEarlyDO
 Description: Sets T variables for all routes in a solution, as late as possible for pickups, based on price for charging stations, as early as possible for dropoffs
 *************************************************************************************/
-void ScheduleLatePUEarlyDO(TSol& s, int nbVehicles, int nbUsers, std::vector <TNode>& node, std::vector <std::vector <double> >& dist, std::vector <double> elecPrices, int periodLength);
+void ScheduleLatePUEarlyDO(TSol& s, const TProblem& problem);
 
 /************************************************************************************
 Method: ScheduleRKPUEarlyDO
 Description: Sets T variables for all routes in a solution, RK-based for pickups, price-based for charging stations, as early as possible for dropoffs.
 Note: Pickups directly after a charging stationed are scheduled as late as possible to ensure consistency with LT of charging station (calculated earlier in algorithm)
 *************************************************************************************/
-void ScheduleRkPUEarlyDO(TSol& s, int nbVehicles, int nbUsers, std::vector <TNode>& node, std::vector <std::vector <double> >& dist, std::vector <double> elecPrices, int periodLength);
+void ScheduleRkPUEarlyDO(TSol& s, const TProblem& problem);
 
 
 struct ZL { // Struct used for representing a zero-load point
@@ -48,6 +56,7 @@ struct ZL { // Struct used for representing a zero-load point
     double price;
     double window; //window of opportunity during which charging could possibly occur (not taking into account travel times to charging station etc. initially) // LT next pick-up - ET zero-load drop-off - drop-off service time
     double rk;
+    int origin; // position of the zero-load in the route before charging stations were inserted
 };
 
 
@@ -0,0 +1,44 @@
+//#pragma once
+#ifndef _THREADRANDOM_H
+#define _THREADRANDOM_H
+
+#include <stdlib.h>
+#include <random>
+#include <omp.h>
+
+// number of the current run, set by SeedRandom() (the streams of the threads are reseeded when it changes)
+inline unsigned runNumber = 0;
+inline unsigned runSeed = 1;
+
+/************************************************************************************
+ Method: SeedRandom
+ Description: seed rand() and the random streams of the threads for a new run
+*************************************************************************************/
+inline void SeedRandom(unsigned seed)
+{
+    srand(seed);
+    runSeed = seed;
+    runNumber++;
+}
+
+/************************************************************************************
+ Method: ThreadRand
+ Description: random int in [0, RAND_MAX] from the stream of the calling thread. Thread 0
+ (and the serial code) uses rand(), so a run with one thread is unchanged; the other omp
+ threads have their own generator, seeded from the run seed and their thread number.
+*************************************************************************************/
+inline int ThreadRand()
+{
+    int thread = omp_get_thread_num();
+    if (thread == 0) return rand();
+
+    static thread_local std::minstd_rand threadRng;
+    static thread_local unsigned threadRun = 0;
+    if (threadRun != runNumber) {
+        threadRun = runNumber;
+        threadRng.seed(runSeed * 7919u + thread);
+    }
+    return (int)(threadRng() % ((unsigned)RAND_MAX + 1u));
+}
+
+#endif